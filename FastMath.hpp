@@ -0,0 +1,169 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Polynomial approximations of the elementary functions
+//
+// Branchless and free of the library calls, so the loops over
+// the particle arrays, that use them, are vectorized by the
+// compiler; the array versions below are such loops.
+// Error bounds against libm (double precision), that hold with
+// -ffast-math and /fp:fast as well, checked by tools/CheckFastMath.cpp:
+//
+// fastSin, fastCos  - absolute error < 1.5e-7 for |x| <= 8192 radians
+//                     (the range reduction loses the precision beyond)
+// fastExp           - relative error < 3e-7 for x in [-87, 88],
+//                     the arguments out of it are clamped
+// fastExp2          - relative error < 3e-7 for x in [-126, 127]
+// fastLog2          - absolute error < 3e-7 for x in [0.5, 2],
+//                     relative error < 1.5e-7 for the other normal x > 0
+//
+// See ParticleSystem::setFastMath
+
+namespace fast_math_detail
+{
+	inline float fromBits(std::uint32_t bits)
+	{
+		float value;
+		std::memcpy(&value, &bits, sizeof(value));
+
+		return value;
+	}
+
+	inline std::uint32_t toBits(float value)
+	{
+		std::uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+
+		return bits;
+	}
+
+	// Round to the nearest integer (the halves away from zero), valid for |x| < 2^31
+	//
+	// Through the integer conversion: the (x + 1.5 * 2^23) - 1.5 * 2^23
+	// trick is folded to x by -ffast-math and /fp:fast
+	inline float round(float x)
+	{
+		return static_cast<float>(static_cast<std::int32_t>(x + std::copysign(0.5f, x)));
+	}
+}
+
+inline void fastSinCos(float x, float& sine, float& cosine)
+{
+	using namespace fast_math_detail;
+
+	// x = q * pi/2 + r, |r| <= pi/4
+	//
+	// The reduction is a single step in double: a Cody-Waite chain
+	// of float steps would be reassociated into one by -ffast-math
+	float q = round(x * 0.636619772f);
+	auto r = static_cast<float>(x - static_cast<double>(q) * 1.5707963267948966);
+
+	float r2 = r * r;
+
+	// Minimax polynomials on [-pi/4, pi/4] (Cephes)
+	float s = r + r * r2 * (-1.6666654611e-1f + r2 * (8.3321608736e-3f + r2 * -1.9515295891e-4f));
+	float c = 1.0f - 0.5f * r2 + r2 * r2 * (4.166664568e-2f + r2 * (-1.388731625e-3f + r2 * 2.443315711e-5f));
+
+	// Rotate by the quadrant
+	auto quadrant = static_cast<std::int32_t>(q);
+	bool is_swapped = quadrant & 1;
+
+	float sine_value = is_swapped ? c : s;
+	float cosine_value = is_swapped ? s : c;
+
+	sine = (quadrant & 2) ? -sine_value : sine_value;
+	cosine = ((quadrant + 1) & 2) ? -cosine_value : cosine_value;
+}
+
+inline float fastSin(float x)
+{
+	float sine, cosine;
+	fastSinCos(x, sine, cosine);
+
+	return sine;
+}
+
+inline float fastCos(float x)
+{
+	float sine, cosine;
+	fastSinCos(x, sine, cosine);
+
+	return cosine;
+}
+
+inline float fastExp2(float x)
+{
+	using namespace fast_math_detail;
+
+	x = (x < -126.0f) ? -126.0f : (x > 127.0f) ? 127.0f : x;
+
+	// 2^x = 2^n * 2^f, |f| <= 0.5
+	float n = round(x);
+	float f = x - n;
+
+	float p = 1.0f + f * (6.931471806e-1f + f * (2.402265070e-1f + f * (5.550410866e-2f
+		+ f * (9.618129108e-3f + f * (1.333355815e-3f + f * 1.540353039e-4f)))));
+
+	auto exponent = static_cast<std::uint32_t>(static_cast<std::int32_t>(n) + 127) << 23;
+
+	return p * fromBits(exponent);
+}
+
+inline float fastExp(float x)
+{
+	using namespace fast_math_detail;
+
+	x = (x < -87.0f) ? -87.0f : (x > 88.0f) ? 88.0f : x;
+
+	// e^x = 2^n * e^r, |r| <= ln(2) / 2, reduced in double as above
+	float n = round(x * 1.442695041f);
+	auto r = static_cast<float>(x - static_cast<double>(n) * 0.6931471805599453);
+
+	// Minimax polynomial (Cephes)
+	float p = 1.0f + r + r * r * (5.0000001201e-1f + r * (1.6666665459e-1f + r * (4.1665795894e-2f
+		+ r * (8.3334519073e-3f + r * (1.3981999507e-3f + r * 1.9875691500e-4f)))));
+
+	auto exponent = static_cast<std::uint32_t>(static_cast<std::int32_t>(n) + 127) << 23;
+
+	return p * fromBits(exponent);
+}
+
+inline float fastLog2(float x)
+{
+	using namespace fast_math_detail;
+
+	std::uint32_t bits = toBits(x);
+
+	// x = 2^e * m, m in [sqrt(1/2), sqrt(2))
+	auto exponent = static_cast<std::int32_t>((bits >> 23) & 0xFF) - 127;
+	float m = fromBits((bits & 0x007FFFFF) | 0x3F800000);
+
+	bool is_high = m > 1.414213562f;
+	m = is_high ? m * 0.5f : m;
+	exponent = is_high ? exponent + 1 : exponent;
+
+	// ln(m) = 2 * atanh(s), s = (m - 1) / (m + 1), |s| < 0.172
+	float s = (m - 1.0f) / (m + 1.0f);
+	float s2 = s * s;
+	float ln = 2.0f * s * (1.0f + s2 * (0.333333333f + s2 * (0.2f + s2 * (0.142857143f + s2 * 0.111111111f))));
+
+	return static_cast<float>(exponent) + ln * 1.442695041f;
+}
+
+// Array versions
+
+inline void fastSinCos(const float* angles, float* sines, float* cosines, std::size_t count)
+{
+	for (std::size_t i = 0; i < count; ++i)
+		fastSinCos(angles[i], sines[i], cosines[i]);
+}
+
+inline void fastExp(const float* values, float* results, std::size_t count)
+{
+	for (std::size_t i = 0; i < count; ++i)
+		results[i] = fastExp(values[i]);
+}
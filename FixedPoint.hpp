@@ -0,0 +1,179 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// Q16.16 fixed-point numbers of the deterministic mode
+//
+// All the arithmetic is integer, so the results are bit-identical
+// on every machine and with every compiler, unlike the floats, which
+// depend on the contraction into FMA and on the libm. The range is
+// [-32768, 32768) with the step of 1/65536.
+//
+// The angles are binary: the full turn is 65536 units, so they wrap
+// around by themselves. The sine table is built at compile time by an
+// integer Taylor series, so it doesn't depend on the libm either.
+//
+// See ParticleSystem::setDeterministic
+
+using Fixed = std::int32_t;
+
+constexpr int   fixed_shift = 16;
+constexpr Fixed fixed_one   = 1 << fixed_shift;
+
+// Conversions are exact for the same input, the value is clamped to the range
+inline Fixed toFixed(float value)
+{
+	constexpr float limit = 32767.0f;
+
+	value = (value < -limit) ? -limit : (value > limit) ? limit : value;
+
+	return static_cast<Fixed>(std::lround(value * fixed_one));
+}
+
+inline float toFloat(Fixed value)
+{
+	return static_cast<float>(value) * (1.0f / fixed_one);
+}
+
+// Wraps around on the overflow instead of the undefined behavior
+inline Fixed fixedAdd(Fixed a, Fixed b)
+{
+	return static_cast<Fixed>(static_cast<std::uint32_t>(a) + static_cast<std::uint32_t>(b));
+}
+
+// Stays at the end of the range on the overflow, for the values
+// that must keep their sign (e.g. the velocity under a constant acceleration)
+inline Fixed fixedAddSaturated(Fixed a, Fixed b)
+{
+	std::int64_t sum = static_cast<std::int64_t>(a) + b;
+
+	return static_cast<Fixed>(std::clamp<std::int64_t>(sum, INT32_MIN, INT32_MAX));
+}
+
+inline Fixed fixedMul(Fixed a, Fixed b)
+{
+	return static_cast<Fixed>((static_cast<std::int64_t>(a) * b) >> fixed_shift);
+}
+
+namespace fixed_point_detail
+{
+	constexpr std::size_t quarter = 1024;
+
+	// sin(pi/2 * i / quarter) in Q16.16, the series is summed in Q2.30
+	constexpr std::array<Fixed, quarter + 1> makeSineTable()
+	{
+		std::array<Fixed, quarter + 1> table{};
+
+		constexpr std::int64_t half_pi = 1686629713; // pi/2 * 2^30
+
+		for (std::size_t i = 0; i <= quarter; ++i)
+		{
+			std::int64_t x = half_pi * static_cast<std::int64_t>(i) / static_cast<std::int64_t>(quarter);
+			std::int64_t x2 = (x * x) >> 30;
+			std::int64_t term = x;
+			std::int64_t sum = x;
+
+			for (std::int64_t n = 1; n < 10; ++n)
+			{
+				term = -((term * x2) >> 30) / ((2 * n) * (2 * n + 1));
+				sum += term;
+			}
+
+			table[i] = static_cast<Fixed>((sum + (1 << 13)) >> 14);
+		}
+
+		return table;
+	}
+
+	inline constexpr auto sine_table = makeSineTable();
+}
+
+// Sine and cosine of the binary angle, linearly interpolated
+inline void fixedSinCos(std::uint32_t angle, Fixed& sine, Fixed& cosine)
+{
+	using namespace fixed_point_detail;
+
+	std::uint32_t quadrant = (angle >> 14) & 3;
+	std::uint32_t index = (angle >> 4) & (quarter - 1);
+	auto fraction = static_cast<Fixed>(angle & 15);
+
+	Fixed s = sine_table[index] + (((sine_table[index + 1] - sine_table[index]) * fraction) >> 4);
+	Fixed c = sine_table[quarter - index] + (((sine_table[quarter - index - 1] - sine_table[quarter - index]) * fraction) >> 4);
+
+	switch (quadrant)
+	{
+		case 0: sine =  s; cosine =  c; break;
+		case 1: sine =  c; cosine = -s; break;
+		case 2: sine = -s; cosine = -c; break;
+		default: sine = -c; cosine = s; break;
+	}
+}
+
+// Binary angle of the direction (x, y), like std::atan2
+//
+// 16 iterations of CORDIC in the integers, the error is within
+// a couple of units; the zero vector gives zero
+inline std::uint32_t fixedAtan2(Fixed y, Fixed x)
+{
+	// atan(2^-i) in 1/256 of the unit
+	constexpr std::int32_t atan_table[16] =
+	{
+		2097152, 1238021, 654136, 332050, 166669, 83416, 41718, 20860,
+		10430, 5215, 2608, 1304, 652, 326, 163, 81
+	};
+
+	std::int64_t vx = x;
+	std::int64_t vy = y;
+	std::int32_t angle = 0;
+
+	// Into the right half-plane, where CORDIC converges
+	if (vx < 0)
+	{
+		vx = -vx;
+		vy = -vy;
+		angle = 32768 << 8;
+	}
+
+	// The short vectors are stretched, the precision depends on the length
+	while (vx != 0 || vy != 0)
+	{
+		if (vx >= (1 << 28) || vy >= (1 << 28) || vy <= -(1 << 28))
+			break;
+
+		vx *= 2;
+		vy *= 2;
+	}
+
+	for (int i = 0; i < 16; ++i)
+	{
+		std::int64_t tx = vx;
+
+		if (vy > 0)
+		{
+			vx += vy >> i;
+			vy -= tx >> i;
+			angle += atan_table[i];
+		}
+		else
+		{
+			vx -= vy >> i;
+			vy += tx >> i;
+			angle -= atan_table[i];
+		}
+	}
+
+	if (x == 0 && y == 0)
+		return 0;
+
+	return static_cast<std::uint32_t>((angle + 128) >> 8) & 0xFFFF;
+}
+
+// Binary angle of the angle in degrees, the rounding is the same everywhere
+inline std::int32_t toBinaryAngle(float degrees)
+{
+	return static_cast<std::int32_t>(std::lround(degrees * (65536.0f / 360.0f)));
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+// Build configuration of the particle systems
+//
+// All the instrumentation of the systems (the costs, the memory
+// high-water marks, the histograms and the trace scopes) is
+// controlled by PARTICLE_SYSTEM_INSTRUMENTATION, which is 1 by default.
+// Define it to 0 for the shipping builds: then the hot loops
+// compile exactly as if there were no instrumentation at all,
+// and the costs of the systems stay zero.
+//
+// The trace scopes need PARTICLE_SYSTEM_PROFILING in addition,
+// see ParticleProfiler.hpp.
+//
+// Define both for every file, that includes the headers of the
+// particles, as the layout of the systems depends on them.
+#if !defined(PARTICLE_SYSTEM_INSTRUMENTATION)
+#define PARTICLE_SYSTEM_INSTRUMENTATION 1
+#endif
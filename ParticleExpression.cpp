@@ -0,0 +1,655 @@
+#include "ParticleExpression.hpp"
+#include "FastMath.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+
+namespace
+{
+	// Storage arrays, bound to the registers 0 ... 7
+	constexpr const char* variable_names[] = { "x", "y", "vx", "vy", "sx", "sy", "rotation", "life", "dt" };
+
+	constexpr std::size_t array_count = 8;
+	constexpr std::size_t dt_register = 8;
+	constexpr std::size_t variable_count = 9;
+	constexpr std::size_t max_registers = 256;
+
+	// Operands of the compiler, numbered by the kind until the
+	// program is complete and the registers are laid out
+	constexpr int constant_base = 1000;
+	constexpr int local_base = 2000;
+	constexpr int temp_base = 3000;
+
+	float hashLattice(std::int32_t x, std::int32_t y)
+	{
+		std::uint32_t h = static_cast<std::uint32_t>(x) * 374761393u + static_cast<std::uint32_t>(y) * 668265263u;
+		h = (h ^ (h >> 13)) * 1274126177u;
+		h ^= h >> 16;
+
+		return static_cast<float>(h & 0xFFFFFF) * (2.0f / 16777216.0f) - 1.0f;
+	}
+
+	float valueNoise(float x, float y)
+	{
+		x = std::clamp(x, -1e6f, 1e6f);
+		y = std::clamp(y, -1e6f, 1e6f);
+
+		float fx = std::floor(x);
+		float fy = std::floor(y);
+		float tx = x - fx;
+		float ty = y - fy;
+
+		auto ix = static_cast<std::int32_t>(fx);
+		auto iy = static_cast<std::int32_t>(fy);
+
+		// Smoothstep weights
+		tx = tx * tx * (3.0f - 2.0f * tx);
+		ty = ty * ty * (3.0f - 2.0f * ty);
+
+		float top = hashLattice(ix, iy) + (hashLattice(ix + 1, iy) - hashLattice(ix, iy)) * tx;
+		float bottom = hashLattice(ix, iy + 1) + (hashLattice(ix + 1, iy + 1) - hashLattice(ix, iy + 1)) * tx;
+
+		return top + (bottom - top) * ty;
+	}
+}
+
+class ParticleExpression::Compiler
+{
+public:
+	struct Function
+	{
+		const char* name;
+		OpCode      op;
+		std::size_t arguments;
+	};
+
+	explicit Compiler(std::string_view source) :
+		m_source(source),
+		m_position(0),
+		m_temps(0),
+		m_max_temps(0)
+	{
+	}
+
+	bool compile()
+	{
+		while (skipSeparators())
+		{
+			if (!statement())
+				return false;
+		}
+
+		return true;
+	}
+
+	const std::string& getError() const
+	{
+		return m_error;
+	}
+
+	// Lay out the registers and move the program into the expression
+	bool finish(ParticleExpression& expression)
+	{
+		std::size_t constants = m_constants.size();
+		std::size_t locals = m_locals.size();
+		std::size_t total = variable_count + constants + locals + m_max_temps;
+
+		if (total > max_registers)
+			return fail("the expression is too complex");
+
+		auto map = [&](int operand)
+		{
+			if (operand >= temp_base)
+				return static_cast<std::uint8_t>(variable_count + constants + locals + (operand - temp_base));
+			if (operand >= local_base)
+				return static_cast<std::uint8_t>(variable_count + constants + (operand - local_base));
+			if (operand >= constant_base)
+				return static_cast<std::uint8_t>(variable_count + (operand - constant_base));
+
+			return static_cast<std::uint8_t>(operand);
+		};
+
+		expression.m_code.clear();
+
+		for (const auto& pending : m_code)
+		{
+			std::uint8_t c = (pending.op == OpCode::Curve) ? static_cast<std::uint8_t>(pending.c) : map(pending.c);
+			expression.m_code.push_back({ pending.op, map(pending.dst), map(pending.a), map(pending.b), c });
+		}
+
+		expression.m_constants = m_constants;
+		expression.m_curves = m_curves;
+		expression.m_curve_values = m_curve_values;
+		expression.m_register_count = total;
+
+		return true;
+	}
+
+private:
+	struct Pending
+	{
+		OpCode op;
+		int    dst;
+		int    a;
+		int    b;
+		int    c;
+	};
+
+	bool fail(const std::string& message)
+	{
+		m_error = message + " at " + std::to_string(m_position);
+		return false;
+	}
+
+	int invalid(const std::string& message)
+	{
+		fail(message);
+		return -1;
+	}
+
+	void skipSpaces()
+	{
+		while (m_position < m_source.size())
+		{
+			char c = m_source[m_position];
+
+			if (c == '#')
+			{
+				while (m_position < m_source.size() && m_source[m_position] != '\n')
+					++m_position;
+			}
+			else if (c == ' ' || c == '\t' || c == '\r')
+				++m_position;
+			else
+				break;
+		}
+	}
+
+	// Skip the empty statements, return false at the end of the source
+	bool skipSeparators()
+	{
+		skipSpaces();
+
+		while (m_position < m_source.size() && (m_source[m_position] == ';' || m_source[m_position] == '\n'))
+		{
+			++m_position;
+			skipSpaces();
+		}
+
+		return m_position < m_source.size();
+	}
+
+	bool accept(char c)
+	{
+		skipSpaces();
+
+		if (m_position < m_source.size() && m_source[m_position] == c)
+		{
+			++m_position;
+			return true;
+		}
+
+		return false;
+	}
+
+	std::string_view identifier()
+	{
+		skipSpaces();
+
+		std::size_t start = m_position;
+
+		while (m_position < m_source.size() && (std::isalnum(static_cast<unsigned char>(m_source[m_position])) || m_source[m_position] == '_'))
+			++m_position;
+
+		if (start < m_position && std::isdigit(static_cast<unsigned char>(m_source[start])))
+		{
+			m_position = start;
+			return {};
+		}
+
+		return m_source.substr(start, m_position - start);
+	}
+
+	bool number(float& value)
+	{
+		skipSpaces();
+
+		if (m_position >= m_source.size())
+			return false;
+
+		char c = m_source[m_position];
+
+		if (!std::isdigit(static_cast<unsigned char>(c)) && c != '.')
+			return false;
+
+		std::string text(m_source.substr(m_position, 32));
+		char* end = nullptr;
+		value = std::strtof(text.c_str(), &end);
+		m_position += static_cast<std::size_t>(end - text.c_str());
+
+		return true;
+	}
+
+	int findVariable(std::string_view name) const
+	{
+		for (std::size_t i = 0; i < variable_count; ++i)
+		{
+			if (name == variable_names[i])
+				return static_cast<int>(i);
+		}
+
+		for (std::size_t i = 0; i < m_locals.size(); ++i)
+		{
+			if (name == m_locals[i])
+				return local_base + static_cast<int>(i);
+		}
+
+		return -1;
+	}
+
+	int constant(float value)
+	{
+		auto found = std::find(m_constants.begin(), m_constants.end(), value);
+
+		if (found != m_constants.end())
+			return constant_base + static_cast<int>(found - m_constants.begin());
+
+		m_constants.push_back(value);
+
+		return constant_base + static_cast<int>(m_constants.size() - 1);
+	}
+
+	int allocateTemp()
+	{
+		int temp = temp_base + static_cast<int>(m_temps++);
+		m_max_temps = std::max(m_max_temps, m_temps);
+
+		return temp;
+	}
+
+	bool statement()
+	{
+		std::string_view name = identifier();
+
+		if (name.empty())
+			return fail("expected a name");
+
+		if (!accept('='))
+			return fail("expected '='");
+
+		if (name == "dt")
+			return fail("dt is read only");
+
+		m_temps = 0;
+
+		int value = expression();
+
+		if (value < 0)
+			return false;
+
+		skipSpaces();
+
+		if (m_position < m_source.size() && m_source[m_position] != ';' && m_source[m_position] != '\n')
+			return fail("unexpected symbol");
+
+		// A new local is defined after its expression, so it can't refer to itself
+		int target = findVariable(name);
+
+		if (target < 0)
+		{
+			m_locals.emplace_back(name);
+			target = local_base + static_cast<int>(m_locals.size() - 1);
+		}
+
+		// The last instruction writes the target directly, if it computed the value
+		if (value >= temp_base && !m_code.empty() && m_code.back().dst == value)
+			m_code.back().dst = target;
+		else
+			m_code.push_back({ OpCode::Move, target, value, value, value });
+
+		return true;
+	}
+
+	// The operands are released right after their use, so the
+	// result can take the register of the first of them
+	int binary(OpCode op, int a, int b, std::size_t saved)
+	{
+		m_temps = saved;
+
+		int dst = allocateTemp();
+		m_code.push_back({ op, dst, a, b, b });
+
+		return dst;
+	}
+
+	int expression()
+	{
+		std::size_t saved = m_temps;
+		int left = term();
+
+		while (left >= 0)
+		{
+			OpCode op;
+
+			if (accept('+'))
+				op = OpCode::Add;
+			else if (accept('-'))
+				op = OpCode::Sub;
+			else
+				break;
+
+			int right = term();
+
+			if (right < 0)
+				return -1;
+
+			left = binary(op, left, right, saved);
+		}
+
+		return left;
+	}
+
+	int term()
+	{
+		std::size_t saved = m_temps;
+		int left = unary();
+
+		while (left >= 0)
+		{
+			OpCode op;
+
+			if (accept('*'))
+				op = OpCode::Mul;
+			else if (accept('/'))
+				op = OpCode::Div;
+			else
+				break;
+
+			int right = unary();
+
+			if (right < 0)
+				return -1;
+
+			left = binary(op, left, right, saved);
+		}
+
+		return left;
+	}
+
+	int unary()
+	{
+		if (accept('-'))
+		{
+			std::size_t saved = m_temps;
+			int value = unary();
+
+			if (value < 0)
+				return -1;
+
+			// Negative numbers are the constants
+			if (value >= constant_base && value < local_base)
+				return constant(-m_constants[value - constant_base]);
+
+			return binary(OpCode::Neg, value, value, saved);
+		}
+
+		return primary();
+	}
+
+	int primary()
+	{
+		float value;
+
+		if (number(value))
+			return constant(value);
+
+		if (accept('('))
+		{
+			int inner = expression();
+
+			if (inner >= 0 && !accept(')'))
+				return invalid("expected ')'");
+
+			return inner;
+		}
+
+		std::string_view name = identifier();
+
+		if (name.empty())
+			return invalid("expected a value");
+
+		if (accept('('))
+			return call(name);
+
+		int variable = findVariable(name);
+
+		if (variable < 0)
+			return invalid("unknown name '" + std::string(name) + "'");
+
+		return variable;
+	}
+
+	int call(std::string_view name)
+	{
+		static constexpr Function functions[] =
+		{
+			{ "sin",   OpCode::Sin,   1 },
+			{ "cos",   OpCode::Cos,   1 },
+			{ "abs",   OpCode::Abs,   1 },
+			{ "sqrt",  OpCode::Sqrt,  1 },
+			{ "floor", OpCode::Floor, 1 },
+			{ "min",   OpCode::Min,   2 },
+			{ "max",   OpCode::Max,   2 },
+			{ "step",  OpCode::Step,  2 },
+			{ "noise", OpCode::Noise, 2 },
+			{ "clamp", OpCode::Clamp, 3 },
+			{ "mix",   OpCode::Mix,   3 }
+		};
+
+		std::size_t saved = m_temps;
+
+		if (name == "curve")
+			return curve(saved);
+
+		const Function* function = nullptr;
+
+		for (const auto& candidate : functions)
+		{
+			if (name == candidate.name)
+				function = &candidate;
+		}
+
+		if (!function)
+			return invalid("unknown function '" + std::string(name) + "'");
+
+		int arguments[3] = {};
+
+		for (std::size_t i = 0; i < function->arguments; ++i)
+		{
+			if (i > 0 && !accept(','))
+				return invalid("expected ','");
+
+			arguments[i] = expression();
+
+			if (arguments[i] < 0)
+				return -1;
+		}
+
+		if (!accept(')'))
+			return invalid("expected ')'");
+
+		m_temps = saved;
+
+		int dst = allocateTemp();
+		int b = (function->arguments > 1) ? arguments[1] : arguments[0];
+		int c = (function->arguments > 2) ? arguments[2] : b;
+
+		m_code.push_back({ function->op, dst, arguments[0], b, c });
+
+		return dst;
+	}
+
+	int curve(std::size_t saved)
+	{
+		int t = expression();
+
+		if (t < 0)
+			return -1;
+
+		Curve curve{ static_cast<std::uint32_t>(m_curve_values.size()), 0 };
+
+		while (accept(','))
+		{
+			float value;
+			bool is_negative = accept('-');
+
+			if (!number(value))
+				return invalid("the curve takes the constant values only");
+
+			m_curve_values.push_back(is_negative ? -value : value);
+			++curve.size;
+		}
+
+		if (!accept(')'))
+			return invalid("expected ')'");
+
+		if (curve.size < 2)
+			return invalid("the curve needs two values at least");
+
+		if (m_curves.size() == max_registers)
+			return invalid("too many curves");
+
+		m_curves.push_back(curve);
+
+		m_temps = saved;
+
+		int dst = allocateTemp();
+		m_code.push_back({ OpCode::Curve, dst, t, t, static_cast<int>(m_curves.size() - 1) });
+
+		return dst;
+	}
+
+	std::string_view         m_source;
+	std::size_t              m_position;
+	std::string              m_error;
+	std::vector<Pending>     m_code;
+	std::vector<float>       m_constants;
+	std::vector<std::string> m_locals;
+	std::vector<Curve>       m_curves;
+	std::vector<float>       m_curve_values;
+	std::size_t              m_temps;
+	std::size_t              m_max_temps;
+};
+
+bool ParticleExpression::compile(std::string_view source)
+{
+	Compiler compiler(source);
+
+	if (!compiler.compile() || !compiler.finish(*this))
+	{
+		m_error = compiler.getError();
+		return false;
+	}
+
+	m_error.clear();
+
+	return true;
+}
+
+void ParticleExpression::run(ParticleStorage& storage, std::size_t first, std::size_t count, float dt, float* scratch) const
+{
+	if (m_code.empty())
+		return;
+
+	float* registers[max_registers];
+
+	// dt, the constants, the locals and the temps live in the scratch
+	for (std::size_t r = dt_register; r < m_register_count; ++r)
+		registers[r] = scratch + (r - dt_register) * block_size;
+
+	std::fill(registers[dt_register], registers[dt_register] + block_size, dt);
+
+	for (std::size_t i = 0; i < m_constants.size(); ++i)
+		std::fill(registers[variable_count + i], registers[variable_count + i] + block_size, m_constants[i]);
+
+	float* arrays[array_count] =
+	{
+		storage.position_x, storage.position_y, storage.velocity_x, storage.velocity_y,
+		storage.size_x, storage.size_y, storage.rotation, storage.lifetime
+	};
+
+	std::size_t end = first + count;
+
+	for (std::size_t start = first; start < end; start += block_size)
+	{
+		std::size_t size = std::min(block_size, end - start);
+
+		for (std::size_t v = 0; v < array_count; ++v)
+			registers[v] = arrays[v] + start;
+
+		for (const auto& instruction : m_code)
+		{
+			float* d = registers[instruction.dst];
+			const float* a = registers[instruction.a];
+			const float* b = registers[instruction.b];
+			const float* c = registers[instruction.c];
+
+			switch (instruction.op)
+			{
+				case OpCode::Move:  for (std::size_t i = 0; i < size; ++i) d[i] = a[i]; break;
+				case OpCode::Add:   for (std::size_t i = 0; i < size; ++i) d[i] = a[i] + b[i]; break;
+				case OpCode::Sub:   for (std::size_t i = 0; i < size; ++i) d[i] = a[i] - b[i]; break;
+				case OpCode::Mul:   for (std::size_t i = 0; i < size; ++i) d[i] = a[i] * b[i]; break;
+				case OpCode::Div:   for (std::size_t i = 0; i < size; ++i) d[i] = a[i] / b[i]; break;
+				case OpCode::Neg:   for (std::size_t i = 0; i < size; ++i) d[i] = -a[i]; break;
+				case OpCode::Sin:   for (std::size_t i = 0; i < size; ++i) d[i] = fastSin(a[i]); break;
+				case OpCode::Cos:   for (std::size_t i = 0; i < size; ++i) d[i] = fastCos(a[i]); break;
+				case OpCode::Abs:   for (std::size_t i = 0; i < size; ++i) d[i] = std::fabs(a[i]); break;
+				case OpCode::Sqrt:  for (std::size_t i = 0; i < size; ++i) d[i] = std::sqrt(std::max(a[i], 0.0f)); break;
+				case OpCode::Floor: for (std::size_t i = 0; i < size; ++i) d[i] = std::floor(a[i]); break;
+				case OpCode::Min:   for (std::size_t i = 0; i < size; ++i) d[i] = std::min(a[i], b[i]); break;
+				case OpCode::Max:   for (std::size_t i = 0; i < size; ++i) d[i] = std::max(a[i], b[i]); break;
+				case OpCode::Step:  for (std::size_t i = 0; i < size; ++i) d[i] = (b[i] < a[i]) ? 0.0f : 1.0f; break;
+				case OpCode::Clamp: for (std::size_t i = 0; i < size; ++i) d[i] = std::min(std::max(a[i], b[i]), c[i]); break;
+				case OpCode::Mix:   for (std::size_t i = 0; i < size; ++i) d[i] = a[i] + (b[i] - a[i]) * c[i]; break;
+				case OpCode::Noise: for (std::size_t i = 0; i < size; ++i) d[i] = valueNoise(a[i], b[i]); break;
+
+				case OpCode::Curve:
+				{
+					const Curve& curve = m_curves[instruction.c];
+					const float* values = &m_curve_values[curve.offset];
+					float last = static_cast<float>(curve.size - 1);
+
+					// The comparison takes NaN to 0, as its cast to the index is undefined
+					for (std::size_t i = 0; i < size; ++i)
+					{
+						float position = (a[i] > 0.0f) ? std::min(a[i], 1.0f) * last : 0.0f;
+						float index = std::min(std::floor(position), last - 1.0f);
+						auto k = static_cast<std::size_t>(index);
+
+						d[i] = values[k] + (values[k + 1] - values[k]) * (position - index);
+					}
+
+					break;
+				}
+			}
+		}
+	}
+}
+
+std::size_t ParticleExpression::getScratchSize() const
+{
+	return m_register_count > dt_register ? (m_register_count - dt_register) * block_size : 0;
+}
+
+const std::string& ParticleExpression::getError() const
+{
+	return m_error;
+}
+
+bool ParticleExpression::isEmpty() const
+{
+	return m_code.empty();
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "ParticleStorage.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Custom per-particle behavior, written as a tiny expression language
+//
+// The source is a list of assignments, separated by ';' or new lines,
+// '#' starts a comment:
+//
+// vx = vx * 0.98 + noise(x * 0.01, y * 0.01) * 50 * dt
+// vy = vy + 98 * dt
+// fade = curve(life / 3, 0, 1, 1, 0.5)
+// sx = 32 * fade; sy = sx
+//
+// Variables: x, y, vx, vy, sx, sy (the size), rotation (in degrees),
+// life (the remaining lifetime) and dt (read only); the other names
+// are the locals, assigned before their use.
+// Operators: + - * / and the unary minus, the parentheses.
+// Functions: sin, cos, abs, sqrt, floor, min, max, step(edge, x),
+// clamp(x, min, max), mix(a, b, t), noise(x, y) - the value noise
+// in [-1, 1], curve(t, v0, v1, ..., vn) - the piecewise linear curve
+// through the constant values, evenly spaced over t in [0, 1]
+// (t is clamped to it, NaN gives v0).
+//
+// The source is compiled into a register bytecode. The interpreter
+// runs each instruction over a block of particles, so the dispatch
+// is paid once per block and the instructions themselves are simple
+// loops, that the compiler vectorizes.
+//
+// See ParticleSystem::setBehavior
+class ParticleExpression
+{
+public:
+	static constexpr std::size_t block_size = 64;
+
+	// Compile the source, on failure keep the previous program
+	//
+	// parameter: the source
+	//
+	// return: true on success, see getError otherwise
+	bool compile(std::string_view source);
+
+	// Run the program over the particles [first, first + count)
+	//
+	// parameters: storage of the particles, range, time step,
+	// scratch of getScratchSize() floats
+	void run(ParticleStorage& storage, std::size_t first, std::size_t count, float dt, float* scratch) const;
+
+	// Amount of the floats, that run needs as the scratch
+	std::size_t        getScratchSize() const;
+	const std::string& getError()       const;
+	bool               isEmpty()        const;
+
+private:
+	enum class OpCode : std::uint8_t
+	{
+		Move, Add, Sub, Mul, Div, Neg,
+		Sin, Cos, Abs, Sqrt, Floor,
+		Min, Max, Step, Clamp, Mix,
+		Noise, Curve
+	};
+
+	struct Instruction
+	{
+		OpCode        op;
+		std::uint8_t  dst;
+		std::uint8_t  a;
+		std::uint8_t  b;
+		std::uint8_t  c; // the third argument or the index of the curve
+	};
+
+	struct Curve
+	{
+		std::uint32_t offset; // in m_curve_values
+		std::uint32_t size;
+	};
+
+	class Compiler;
+
+	std::vector<Instruction> m_code;
+	std::vector<float>       m_constants;    // value of the register variables + i
+	std::vector<Curve>       m_curves;
+	std::vector<float>       m_curve_values;
+	std::size_t              m_register_count = 0;
+	std::string              m_error;
+};
@@ -0,0 +1,88 @@
+#include "ParticleHistogram.hpp"
+
+ParticleHistogram::ParticleHistogram(float min, float max)
+{
+	setRange(min, max);
+}
+
+void ParticleHistogram::setRange(float min, float max)
+{
+	m_min = min;
+	m_max = (max > min) ? max : min + 1.0f;
+	m_scale = bucket_count / (m_max - m_min);
+
+	clear();
+}
+
+void ParticleHistogram::add(float value)
+{
+	add(value, 1);
+}
+
+void ParticleHistogram::add(float value, std::uint64_t count)
+{
+	float position = (value - m_min) * m_scale;
+
+	std::size_t bucket = 0;
+
+	if (position >= bucket_count)
+		bucket = bucket_count - 1;
+	else if (position > 0.0f)
+		bucket = static_cast<std::size_t>(position);
+
+	m_counts[bucket] += count;
+}
+
+void ParticleHistogram::clear()
+{
+	for (auto& count : m_counts)
+		count = 0;
+}
+
+float ParticleHistogram::getMin() const
+{
+	return m_min;
+}
+
+float ParticleHistogram::getMax() const
+{
+	return m_max;
+}
+
+std::uint64_t ParticleHistogram::getCount(std::size_t bucket) const
+{
+	return m_counts[bucket];
+}
+
+std::uint64_t ParticleHistogram::getTotal() const
+{
+	std::uint64_t total = 0;
+
+	for (auto count : m_counts)
+		total += count;
+
+	return total;
+}
+
+float ParticleHistogram::getBucketValue(std::size_t bucket) const
+{
+	return m_min + bucket / m_scale;
+}
+
+void ParticleHistogram::writeCsv(std::ostream& stream) const
+{
+	stream << "bucket,count\n";
+
+	for (std::size_t i = 0; i < bucket_count; ++i)
+		stream << getBucketValue(i) << ',' << m_counts[i] << '\n';
+}
+
+void ParticleHistogram::writeJson(std::ostream& stream, const char* name) const
+{
+	stream << "{\"name\":\"" << name << "\",\"min\":" << m_min << ",\"max\":" << m_max << ",\"counts\":[";
+
+	for (std::size_t i = 0; i < bucket_count; ++i)
+		stream << (i ? "," : "") << m_counts[i];
+
+	stream << "]}";
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+// Fixed-bucket histogram of the values in range [min, max)
+//
+// Adding a value is a multiplication and an increment, the values
+// out of the range are counted by the first and the last buckets.
+// Can be exported as CSV or JSON for the offline analysis.
+class ParticleHistogram
+{
+public:
+	static constexpr std::size_t bucket_count = 32;
+
+	ParticleHistogram(float min = 0.0f, float max = 1.0f);
+
+	// Set the range of the values and clear the histogram
+	void setRange(float min, float max);
+
+	void add(float value);
+	void add(float value, std::uint64_t count);
+	void clear();
+
+	float         getMin()                        const;
+	float         getMax()                        const;
+	std::uint64_t getCount(std::size_t bucket)    const;
+	std::uint64_t getTotal()                      const;
+
+	// Lower bound of the bucket
+	float         getBucketValue(std::size_t bucket) const;
+
+	// Write "bucket,count" lines, the bucket is its lower bound
+	void writeCsv(std::ostream& stream) const;
+
+	// Write {"name":..,"min":..,"max":..,"counts":[..]}
+	void writeJson(std::ostream& stream, const char* name) const;
+
+private:
+	std::uint64_t m_counts[bucket_count];
+	float         m_min;
+	float         m_max;
+	float         m_scale;
+};
@@ -0,0 +1,183 @@
+#include "ParticleNode.hpp"
+
+#include <cmath>
+
+ParticleNode::ParticleNode() :
+	m_parent(nullptr),
+	m_scale(1.0f, 1.0f),
+	m_matrix{ 1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f },
+	m_version(1),
+	m_parent_version(0),
+	m_is_dirty(false)
+{
+}
+
+void ParticleNode::setParent(const ParticleNode* parent)
+{
+	if (m_parent == parent)
+		return;
+
+	m_parent = parent;
+	invalidate();
+}
+
+void ParticleNode::setPosition(const sf::Vector2f& position)
+{
+	if (m_position == position)
+		return;
+
+	m_position = position;
+	invalidate();
+}
+
+void ParticleNode::setRotation(sf::Angle rotation)
+{
+	if (m_rotation == rotation)
+		return;
+
+	m_rotation = rotation;
+	invalidate();
+}
+
+void ParticleNode::setScale(const sf::Vector2f& scale)
+{
+	if (m_scale == scale)
+		return;
+
+	m_scale = scale;
+	invalidate();
+}
+
+void ParticleNode::move(const sf::Vector2f& offset)
+{
+	setPosition(m_position + offset);
+}
+
+void ParticleNode::rotate(sf::Angle angle)
+{
+	setRotation(m_rotation + angle);
+}
+
+const ParticleNode* ParticleNode::getParent() const
+{
+	return m_parent;
+}
+
+const sf::Vector2f& ParticleNode::getPosition() const
+{
+	return m_position;
+}
+
+sf::Angle ParticleNode::getRotation() const
+{
+	return m_rotation;
+}
+
+const sf::Vector2f& ParticleNode::getScale() const
+{
+	return m_scale;
+}
+
+sf::Vector2f ParticleNode::transformPoint(const sf::Vector2f& point) const
+{
+	resolve();
+
+	return sf::Vector2f(m_matrix[0] * point.x + m_matrix[1] * point.y + m_matrix[2],
+	                    m_matrix[3] * point.x + m_matrix[4] * point.y + m_matrix[5]);
+}
+
+sf::Vector2f ParticleNode::transformDirection(const sf::Vector2f& direction) const
+{
+	resolve();
+
+	return sf::Vector2f(m_matrix[0] * direction.x + m_matrix[1] * direction.y,
+	                    m_matrix[3] * direction.x + m_matrix[4] * direction.y);
+}
+
+void ParticleNode::transformPointFixed(Fixed& x, Fixed& y) const
+{
+	for (const ParticleNode* node = this; node; node = node->m_parent)
+	{
+		node->transformLinearFixed(x, y);
+
+		x = fixedAdd(x, toFixed(node->m_position.x));
+		y = fixedAdd(y, toFixed(node->m_position.y));
+	}
+}
+
+std::uint32_t ParticleNode::transformDirectionFixed(std::uint32_t angle) const
+{
+	Fixed x, y;
+	fixedSinCos(angle, y, x);
+
+	for (const ParticleNode* node = this; node; node = node->m_parent)
+		node->transformLinearFixed(x, y);
+
+	return fixedAtan2(y, x);
+}
+
+std::uint32_t ParticleNode::getVersion() const
+{
+	resolve();
+
+	return m_version;
+}
+
+void ParticleNode::invalidate()
+{
+	m_is_dirty = true;
+}
+
+void ParticleNode::transformLinearFixed(Fixed& x, Fixed& y) const
+{
+	Fixed sine, cosine;
+	fixedSinCos(static_cast<std::uint32_t>(toBinaryAngle(m_rotation.asDegrees())), sine, cosine);
+
+	// Local: rotate(scale(p)), as in resolve
+	Fixed scaled_x = fixedMul(x, toFixed(m_scale.x));
+	Fixed scaled_y = fixedMul(y, toFixed(m_scale.y));
+
+	x = fixedAdd(fixedMul(cosine, scaled_x), fixedMul(-sine, scaled_y));
+	y = fixedAdd(fixedMul(sine, scaled_x), fixedMul(cosine, scaled_y));
+}
+
+void ParticleNode::resolve() const
+{
+	// Resolves the ancestors first, up to the root
+	std::uint32_t parent_version = m_parent ? m_parent->getVersion() : 0;
+
+	if (!m_is_dirty && parent_version == m_parent_version)
+		return;
+
+	float angle = m_rotation.asRadians();
+	float sine = std::sin(angle);
+	float cosine = std::cos(angle);
+
+	// Local: rotate(scale(p)) + position
+	float local[6] =
+	{
+		cosine * m_scale.x, -sine * m_scale.y,  m_position.x,
+		sine * m_scale.x,    cosine * m_scale.y, m_position.y
+	};
+
+	if (m_parent)
+	{
+		const float* parent = m_parent->m_matrix;
+
+		m_matrix[0] = parent[0] * local[0] + parent[1] * local[3];
+		m_matrix[1] = parent[0] * local[1] + parent[1] * local[4];
+		m_matrix[2] = parent[0] * local[2] + parent[1] * local[5] + parent[2];
+		m_matrix[3] = parent[3] * local[0] + parent[4] * local[3];
+		m_matrix[4] = parent[3] * local[1] + parent[4] * local[4];
+		m_matrix[5] = parent[3] * local[2] + parent[4] * local[5] + parent[5];
+	}
+	else
+	{
+		for (int i = 0; i < 6; ++i)
+			m_matrix[i] = local[i];
+	}
+
+	m_parent_version = parent_version;
+	m_is_dirty = false;
+	++m_version;
+}
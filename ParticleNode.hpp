@@ -0,0 +1,82 @@
+#pragma once
+
+#include "FixedPoint.hpp"
+
+#include <SFML/Graphics.hpp>
+
+#include <cstdint>
+
+// Node of a transform hierarchy, that the emitters are attached to
+//
+// Like sf::Transformable, the node has a position, a rotation and
+// a scale, relative to its parent. The world transform is computed
+// lazily, only when the node or one of its ancestors has changed:
+// every node counts the versions of its world transform, so the
+// attached systems compare a single number per update to learn,
+// whether their emitter has moved.
+// The setters, that get the same value, don't change the version,
+// so the node may be synced from the game object every frame.
+//
+// The parent must outlive the node (or be replaced before
+// the destruction), the cycles aren't allowed.
+//
+// See ParticleSystem::attach
+class ParticleNode
+{
+public:
+	ParticleNode();
+
+	// Set the parent of the node, nullptr for the root
+	void setParent(const ParticleNode* parent);
+
+	void setPosition(const sf::Vector2f& position);
+	void setRotation(sf::Angle rotation);
+	void setScale(const sf::Vector2f& scale);
+	void move(const sf::Vector2f& offset);
+	void rotate(sf::Angle angle);
+
+	const ParticleNode* getParent()   const;
+	const sf::Vector2f& getPosition() const;
+	sf::Angle           getRotation() const;
+	const sf::Vector2f& getScale()    const;
+
+	// Transform the point of the node space into the world space
+	sf::Vector2f transformPoint(const sf::Vector2f& point) const;
+
+	// Transform the direction (without the translation)
+	sf::Vector2f transformDirection(const sf::Vector2f& direction) const;
+
+	// Transform the point in the Q16.16 fixed-point, in place
+	//
+	// Integer arithmetic only (see FixedPoint.hpp), so the result is
+	// the same on every machine, unlike the float transforms above.
+	// Isn't cached: walks the ancestors up to the root on every call.
+	void transformPointFixed(Fixed& x, Fixed& y) const;
+
+	// Transform the direction, given as the binary angle, in the fixed-point
+	//
+	// The direction is transformed as a vector, like by transformDirection,
+	// and its binary angle is returned
+	std::uint32_t transformDirectionFixed(std::uint32_t angle) const;
+
+	// Version of the world transform, changes with every its change
+	std::uint32_t getVersion() const;
+
+private:
+	void invalidate();
+	void resolve() const;
+
+	// Rotation and scale of the node, without the translation
+	void transformLinearFixed(Fixed& x, Fixed& y) const;
+
+	const ParticleNode* m_parent;
+
+	sf::Vector2f m_position;
+	sf::Vector2f m_scale;
+	sf::Angle    m_rotation;
+
+	mutable float         m_matrix[6];      // world transform, the rows (a, b, x) and (c, d, y)
+	mutable std::uint32_t m_version;
+	mutable std::uint32_t m_parent_version; // that m_matrix was computed for
+	mutable bool          m_is_dirty;
+};
@@ -0,0 +1,121 @@
+#include "ParticleProfiler.hpp"
+
+#include <chrono>
+#include <functional>
+#include <thread>
+
+namespace
+{
+	std::uint32_t getThreadId()
+	{
+		thread_local const std::uint32_t id = static_cast<std::uint32_t>(std::hash<std::thread::id>()(std::this_thread::get_id()));
+
+		return id;
+	}
+}
+
+ParticleProfiler::Scope::Scope(const char* name, const void* system) :
+	m_name(name),
+	m_system(system),
+	m_start(ParticleProfiler::now())
+{
+}
+
+ParticleProfiler::Scope::~Scope()
+{
+	ParticleProfiler::getInstance().record(m_name, m_system, m_start, ParticleProfiler::now() - m_start);
+}
+
+ParticleProfiler::CostScope::CostScope(std::int64_t& counter) :
+	m_counter(counter),
+	m_start(ParticleProfiler::now())
+{
+}
+
+ParticleProfiler::CostScope::~CostScope()
+{
+	m_counter += ParticleProfiler::now() - m_start;
+}
+
+ParticleProfiler& ParticleProfiler::getInstance()
+{
+	static ParticleProfiler profiler;
+
+	return profiler;
+}
+
+std::int64_t ParticleProfiler::now()
+{
+	auto time = std::chrono::steady_clock::now().time_since_epoch();
+
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(time).count();
+}
+
+ParticleProfiler::ParticleProfiler() :
+	m_slots(std::make_unique<Slot[]>(capacity)),
+	m_head(0)
+{
+}
+
+void ParticleProfiler::record(const char* name, const void* system, std::int64_t start, std::int64_t duration)
+{
+	std::uint64_t index = m_head.fetch_add(1, std::memory_order_relaxed);
+	Slot& slot = m_slots[index % capacity];
+
+	// Zero marks the slot as being written (seqlock)
+	slot.sequence.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slot.event.name = name;
+	slot.event.system = system;
+	slot.event.thread = getThreadId();
+	slot.event.start = start;
+	slot.event.duration = duration;
+
+	slot.sequence.store(index + 1, std::memory_order_release);
+}
+
+void ParticleProfiler::writeChromeTrace(std::ostream& stream) const
+{
+	std::uint64_t head = m_head.load(std::memory_order_acquire);
+	std::uint64_t first = (head > capacity) ? head - capacity : 0;
+	bool is_first = true;
+
+	stream << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+
+	for (std::uint64_t index = first; index < head; ++index)
+	{
+		const Slot& slot = m_slots[index % capacity];
+
+		if (slot.sequence.load(std::memory_order_acquire) != index + 1)
+			continue;
+
+		Event event = slot.event;
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		if (slot.sequence.load(std::memory_order_relaxed) != index + 1)
+			continue;
+
+		if (!is_first)
+			stream << ',';
+
+		is_first = false;
+
+		// Chrome trace expects the microseconds
+		stream << "\n{\"name\":\"" << event.name << "\",\"cat\":\"particles\",\"ph\":\"X\""
+			<< ",\"ts\":" << event.start / 1000 << '.' << (event.start % 1000) / 100
+			<< ",\"dur\":" << event.duration / 1000 << '.' << (event.duration % 1000) / 100
+			<< ",\"pid\":0,\"tid\":" << event.thread
+			<< ",\"args\":{\"system\":\"" << event.system << "\"}}";
+	}
+
+	stream << "\n]}\n";
+}
+
+void ParticleProfiler::clear()
+{
+	for (std::size_t i = 0; i < capacity; ++i)
+		m_slots[i].sequence.store(0, std::memory_order_relaxed);
+
+	m_head.store(0, std::memory_order_release);
+}
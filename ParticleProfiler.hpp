@@ -0,0 +1,118 @@
+#pragma once
+
+#include "ParticleConfig.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+
+// Timeline of the particle system phases
+//
+// Records the scopes (spawn, update, compaction, vertices, draw)
+// of every system on every thread into a lock-free ring buffer,
+// which keeps the latest 'capacity' events and can be dumped
+// as a Chrome trace (chrome://tracing, ui.perfetto.dev).
+//
+// The scopes are compiled only with PARTICLE_SYSTEM_PROFILING
+// defined, otherwise PARTICLE_PROFILE_SCOPE expands to nothing
+// and the profiler is never touched.
+//
+// Both PARTICLE_COST_SCOPE and PARTICLE_PROFILE_SCOPE expand to nothing,
+// if PARTICLE_SYSTEM_INSTRUMENTATION is 0, see ParticleConfig.hpp.
+//
+// Usage example:
+// code:
+//
+// ParticleProfiler::getInstance().writeChromeTrace(file);
+//
+// end code.
+class ParticleProfiler
+{
+public:
+	static constexpr std::size_t capacity = 1 << 16;
+
+	struct Event
+	{
+		const char*   name     = nullptr;
+		const void*   system   = nullptr;
+		std::uint32_t thread   = 0;
+		std::int64_t  start    = 0; // in nanoseconds
+		std::int64_t  duration = 0; // in nanoseconds
+	};
+
+	// Measures the lifetime of the scope
+	class Scope
+	{
+	public:
+		Scope(const char* name, const void* system);
+		~Scope();
+
+		Scope(const Scope&) = delete;
+		Scope& operator = (const Scope&) = delete;
+
+	private:
+		const char*  m_name;
+		const void*  m_system;
+		std::int64_t m_start;
+	};
+
+	// Adds the lifetime of the scope to the counter
+	class CostScope
+	{
+	public:
+		explicit CostScope(std::int64_t& counter);
+		~CostScope();
+
+		CostScope(const CostScope&) = delete;
+		CostScope& operator = (const CostScope&) = delete;
+
+	private:
+		std::int64_t& m_counter;
+		std::int64_t  m_start;
+	};
+
+	static ParticleProfiler& getInstance();
+
+	// Monotonic time in nanoseconds
+	static std::int64_t now();
+
+	// Safe to call from any thread, never blocks
+	void record(const char* name, const void* system, std::int64_t start, std::int64_t duration);
+
+	// Write the recorded events as a Chrome trace JSON
+	//
+	// The events, which are being overwritten during the call,
+	// are skipped
+	void writeChromeTrace(std::ostream& stream) const;
+
+	void clear();
+
+private:
+	ParticleProfiler();
+
+	struct Slot
+	{
+		std::atomic<std::uint64_t> sequence { 0 };
+		Event                      event;
+	};
+
+	std::unique_ptr<Slot[]>    m_slots;
+	std::atomic<std::uint64_t> m_head;
+};
+
+#define PARTICLE_PROFILE_CONCAT_IMPL(a, b) a##b
+#define PARTICLE_PROFILE_CONCAT(a, b) PARTICLE_PROFILE_CONCAT_IMPL(a, b)
+
+#if PARTICLE_SYSTEM_INSTRUMENTATION && defined(PARTICLE_SYSTEM_PROFILING)
+#define PARTICLE_PROFILE_SCOPE(name) ParticleProfiler::Scope PARTICLE_PROFILE_CONCAT(particle_profile_scope_, __LINE__)(name, this)
+#else
+#define PARTICLE_PROFILE_SCOPE(name)
+#endif
+
+#if PARTICLE_SYSTEM_INSTRUMENTATION
+#define PARTICLE_COST_SCOPE(counter) ParticleProfiler::CostScope PARTICLE_PROFILE_CONCAT(particle_cost_scope_, __LINE__)(counter)
+#else
+#define PARTICLE_COST_SCOPE(counter)
+#endif
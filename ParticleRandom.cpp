@@ -0,0 +1,157 @@
+#include "ParticleRandom.hpp"
+#include "FastMath.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	constexpr float inv_24_bits = 1.0f / 16777216.0f;
+	constexpr float two_pi = 6.283185307f;
+
+	// Spreads the seed over the lanes (splitmix32 finalizer)
+	std::uint32_t mix(std::uint32_t value)
+	{
+		value ^= value >> 16;
+		value *= 0x7FEB352Du;
+		value ^= value >> 15;
+		value *= 0x846CA68Bu;
+		value ^= value >> 16;
+
+		return value;
+	}
+}
+
+ParticleRandom::ParticleRandom(std::uint32_t seed)
+{
+	setSeed(seed);
+}
+
+void ParticleRandom::setSeed(std::uint32_t seed)
+{
+	for (std::size_t lane = 0; lane < lanes; ++lane)
+	{
+		std::uint32_t state = mix(seed + static_cast<std::uint32_t>(lane) * 0x9E3779B9u);
+
+		// Zero is the only state, that xorshift never leaves
+		m_state[lane] = state ? state : 0x9E3779B9u;
+	}
+
+	m_buffer_index = lanes;
+}
+
+void ParticleRandom::fillUniform(float* values, std::size_t count, float min, float max)
+{
+	float scale = (max - min) * inv_24_bits;
+	std::size_t i = 0;
+
+	for (; i + lanes <= count; i += lanes)
+	{
+		for (std::size_t lane = 0; lane < lanes; ++lane)
+		{
+			std::uint32_t x = m_state[lane];
+
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+
+			m_state[lane] = x;
+			values[i + lane] = static_cast<float>(x >> 8) * scale + min;
+		}
+	}
+
+	if (i < count)
+	{
+		std::uint32_t block[lanes];
+		generate(block);
+
+		for (std::size_t lane = 0; i < count; ++i, ++lane)
+			values[i] = static_cast<float>(block[lane] >> 8) * scale + min;
+	}
+}
+
+void ParticleRandom::fillNormal(float* values, std::size_t count, float mean, float deviation)
+{
+	float u1[lanes], u2[lanes];
+
+	for (std::size_t i = 0; i < count; i += 2 * lanes)
+	{
+		// u1 in (0, 1], so the logarithm is finite
+		fillUniform(u1, lanes, inv_24_bits, 1.0f + inv_24_bits);
+		fillUniform(u2, lanes, 0.0f, two_pi);
+
+		float first[lanes], second[lanes];
+
+		for (std::size_t lane = 0; lane < lanes; ++lane)
+		{
+			float radius = std::sqrt(-2.0f * 0.693147181f * fastLog2(u1[lane])) * deviation;
+			float sine, cosine;
+			fastSinCos(u2[lane], sine, cosine);
+
+			first[lane] = radius * cosine + mean;
+			second[lane] = radius * sine + mean;
+		}
+
+		std::size_t left = std::min(count - i, 2 * lanes);
+		std::size_t half = std::min(left, lanes);
+
+		std::copy(first, first + half, values + i);
+		std::copy(second, second + (left - half), values + i + half);
+	}
+}
+
+void ParticleRandom::fillUnitVectors(float* x, float* y, std::size_t count)
+{
+	// The angles are generated into x, then turned into the vectors in place
+	fillUniform(x, count, 0.0f, two_pi);
+
+	for (std::size_t i = 0; i < count; ++i)
+		fastSinCos(x[i], y[i], x[i]);
+}
+
+void ParticleRandom::fillFixed(std::int32_t* values, std::size_t count, std::int32_t min, std::int32_t max)
+{
+	std::int64_t range = static_cast<std::int64_t>(max) - min;
+	std::uint32_t block[lanes];
+
+	for (std::size_t i = 0; i < count; i += lanes)
+	{
+		generate(block);
+
+		std::size_t size = std::min(count - i, lanes);
+
+		for (std::size_t lane = 0; lane < size; ++lane)
+			values[i + lane] = static_cast<std::int32_t>(min + ((range * (block[lane] >> 16)) >> 16));
+	}
+}
+
+std::uint32_t ParticleRandom::next()
+{
+	if (m_buffer_index == lanes)
+	{
+		generate(m_buffer);
+		m_buffer_index = 0;
+	}
+
+	return m_buffer[m_buffer_index++];
+}
+
+float ParticleRandom::next(float min, float max)
+{
+	return static_cast<float>(next() >> 8) * inv_24_bits * (max - min) + min;
+}
+
+void ParticleRandom::generate(std::uint32_t* block)
+{
+	for (std::size_t lane = 0; lane < lanes; ++lane)
+	{
+		std::uint32_t x = m_state[lane];
+
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+
+		m_state[lane] = x;
+		block[lane] = x;
+	}
+}
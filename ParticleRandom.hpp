@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Random generator for the batches of particles
+//
+// Runs 'lanes' independent xorshift32 generators in lockstep,
+// so filling an array is a plain loop over the lanes, that the
+// compiler turns into the vector shifts and xors. The arrays can
+// be filled with uniform values in a range, normal values and
+// unit vectors, each of them in one call.
+//
+// The sequence depends only on the seed, so the same seed gives
+// the same particles on every run.
+class ParticleRandom
+{
+public:
+	static constexpr std::size_t lanes = 16;
+
+	explicit ParticleRandom(std::uint32_t seed = 1);
+
+	void setSeed(std::uint32_t seed);
+
+	// Fill the array with the uniform values in [min, max)
+	void fillUniform(float* values, std::size_t count, float min, float max);
+
+	// Fill the array with the normal values (Box-Muller transform)
+	void fillNormal(float* values, std::size_t count, float mean, float deviation);
+
+	// Fill the arrays with the uniformly directed unit vectors
+	void fillUnitVectors(float* x, float* y, std::size_t count);
+
+	// Fill the array with the uniform integers in [min, max)
+	//
+	// Integer arithmetic only, so the values are the same on every
+	// machine; used for the Q16.16 values and the binary angles
+	void fillFixed(std::int32_t* values, std::size_t count, std::int32_t min, std::int32_t max);
+
+	// Single values, taken from the same lanes
+	std::uint32_t next();
+	float         next(float min, float max);
+
+private:
+	void generate(std::uint32_t* block);
+
+	std::uint32_t m_state[lanes];
+	std::uint32_t m_buffer[lanes];
+	std::size_t   m_buffer_index;
+};
@@ -0,0 +1,202 @@
+#if defined(__cpp_impl_coroutine) || __cplusplus >= 202002L
+
+#include "ParticleScript.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <utility>
+
+ParticleScript ParticleScript::promise_type::get_return_object()
+{
+	return ParticleScript(Handle::from_promise(*this));
+}
+
+void ParticleScript::promise_type::unhandled_exception()
+{
+	std::terminate();
+}
+
+ParticleScript::ParticleScript(Handle handle) :
+	m_handle(handle)
+{
+}
+
+ParticleScript::ParticleScript(ParticleScript&& other) noexcept :
+	m_handle(std::exchange(other.m_handle, nullptr))
+{
+}
+
+ParticleScript& ParticleScript::operator = (ParticleScript&& other) noexcept
+{
+	if (this != &other)
+	{
+		if (m_handle)
+			m_handle.destroy();
+
+		m_handle = std::exchange(other.m_handle, nullptr);
+	}
+
+	return *this;
+}
+
+ParticleScript::~ParticleScript()
+{
+	// Only the scripts, that were never started
+	if (m_handle)
+		m_handle.destroy();
+}
+
+ParticleScheduler::ParticleScheduler(std::pmr::memory_resource* resource) :
+	m_resource(resource),
+	m_timers(resource),
+	m_deferred(resource),
+	m_waiters(resource),
+	m_ready(resource),
+	m_time(0.0),
+	m_script_count(0),
+	m_is_updating(false)
+{
+}
+
+ParticleScheduler::~ParticleScheduler()
+{
+	for (auto& timer : m_timers)
+		timer.handle.destroy();
+
+	for (auto& waiters : m_waiters)
+		for (auto handle : waiters.handles)
+			handle.destroy();
+}
+
+void ParticleScheduler::start(ParticleScript script)
+{
+	ParticleScript::Handle handle = std::exchange(script.m_handle, nullptr);
+
+	if (!handle)
+		return;
+
+	handle.promise().scheduler = this;
+	++m_script_count;
+
+	resume(handle);
+}
+
+void ParticleScheduler::update(float dt)
+{
+	m_time += dt;
+	m_is_updating = true;
+
+	// The timers, that the resumed scripts add, wait in m_deferred,
+	// so a script can't be resumed twice per update
+	while (!m_timers.empty() && m_timers.front().time <= m_time)
+	{
+		std::pop_heap(m_timers.begin(), m_timers.end());
+
+		Timer timer = m_timers.back();
+		m_timers.pop_back();
+
+		if (timer.stop_emission)
+			timer.stop_emission->setEmitted(false);
+
+		resume(timer.handle);
+	}
+
+	for (std::size_t i = 0; i < m_waiters.size();)
+	{
+		if (m_waiters[i].system->getParticleCount() != 0)
+		{
+			++i;
+			continue;
+		}
+
+		// The group is removed before the resumption,
+		// as the resumed scripts may add new waiters
+		m_ready.swap(m_waiters[i].handles);
+
+		if (i + 1 != m_waiters.size())
+			m_waiters[i] = std::move(m_waiters.back());
+
+		m_waiters.pop_back();
+
+		for (auto handle : m_ready)
+			resume(handle);
+
+		m_ready.clear();
+	}
+
+	m_is_updating = false;
+
+	for (const auto& timer : m_deferred)
+	{
+		m_timers.push_back(timer);
+		std::push_heap(m_timers.begin(), m_timers.end());
+	}
+
+	m_deferred.clear();
+}
+
+std::size_t ParticleScheduler::getScriptCount() const
+{
+	return m_script_count;
+}
+
+void ParticleScheduler::Delay::await_suspend(ParticleScript::Handle handle) const
+{
+	handle.promise().scheduler->addTimer(seconds, handle, nullptr);
+}
+
+void ParticleScheduler::Burst::await_suspend(ParticleScript::Handle handle) const
+{
+	system->setRespawnRate(rate);
+	system->setEmitted(true);
+
+	handle.promise().scheduler->addTimer(seconds, handle, system);
+}
+
+void ParticleScheduler::AllDead::await_suspend(ParticleScript::Handle handle) const
+{
+	handle.promise().scheduler->addWaiter(system, handle);
+}
+
+void ParticleScheduler::addTimer(float seconds, ParticleScript::Handle handle, ParticleSystem* stop_emission)
+{
+	Timer timer{ m_time + seconds, handle, stop_emission };
+
+	if (m_is_updating)
+	{
+		m_deferred.push_back(timer);
+		return;
+	}
+
+	m_timers.push_back(timer);
+	std::push_heap(m_timers.begin(), m_timers.end());
+}
+
+void ParticleScheduler::addWaiter(ParticleSystem* system, ParticleScript::Handle handle)
+{
+	auto found = std::find_if(m_waiters.begin(), m_waiters.end(), [system](const Waiters& waiters)
+	{
+		return waiters.system == system;
+	});
+
+	if (found == m_waiters.end())
+	{
+		m_waiters.push_back({ system, std::pmr::vector<ParticleScript::Handle>(m_resource) });
+		found = m_waiters.end() - 1;
+	}
+
+	found->handles.push_back(handle);
+}
+
+void ParticleScheduler::resume(ParticleScript::Handle handle)
+{
+	handle.resume();
+
+	if (handle.done())
+	{
+		handle.destroy();
+		--m_script_count;
+	}
+}
+
+#endif
@@ -0,0 +1,178 @@
+#pragma once
+
+// Needs C++20 (the coroutines)
+
+#include "ParticleSystem.hpp"
+
+#include <coroutine>
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+class ParticleScheduler;
+
+// Effect script, a coroutine that drives the particle systems
+//
+// The script sets up the systems and co_awaits the conditions,
+// it is resumed by the scheduler only when its condition fires:
+//
+// delay(seconds)                 - the simulated time has passed
+// burst(system, rate, seconds)   - the system has emitted at the rate
+//                                  for the time, the emission is off
+// allDead(system)                - the system has no particles
+//
+// Usage example:
+// code:
+//
+// ParticleScript explosion(ParticleSystem& sparks, ParticleSystem& smoke)
+// {
+//     co_await burst(sparks, 200.0f, 0.5f); // charge
+//     sparks.setExplosion(500, 20.0f);      // explode
+//     co_await delay(0.1f);
+//     smoke.setExplosion(100, 40.0f);
+//     co_await allDead(smoke);              // linger
+// }
+//
+// scheduler.start(explosion(sparks, smoke));
+//
+// end code.
+//
+// The script is started by ParticleScheduler::start and is destroyed
+// by the scheduler, when it finishes. The systems and everything
+// else, that the script refers to, must outlive it.
+class ParticleScript
+{
+public:
+	struct promise_type
+	{
+		ParticleScheduler* scheduler = nullptr;
+
+		ParticleScript      get_return_object();
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		std::suspend_always final_suspend()   noexcept { return {}; }
+		void                return_void()              {}
+		void                unhandled_exception();
+	};
+
+	using Handle = std::coroutine_handle<promise_type>;
+
+	ParticleScript(ParticleScript&& other) noexcept;
+	ParticleScript& operator = (ParticleScript&& other) noexcept;
+	~ParticleScript();
+
+	ParticleScript(const ParticleScript&) = delete;
+	ParticleScript& operator = (const ParticleScript&) = delete;
+
+private:
+	friend class ParticleScheduler;
+
+	explicit ParticleScript(Handle handle);
+
+	Handle m_handle;
+};
+
+// Runs the effect scripts
+//
+// The sleeping scripts cost nothing per update: the delays wait
+// in a heap ordered by the wake up time, so only its top is checked,
+// and the allDead waiters are grouped by the system, so the scheduler
+// checks one particle count per system, whatever the amount of the
+// scripts, waiting for it.
+//
+// The unfinished scripts are destroyed along with the scheduler.
+class ParticleScheduler
+{
+public:
+	explicit ParticleScheduler(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+	~ParticleScheduler();
+
+	ParticleScheduler(const ParticleScheduler&) = delete;
+	ParticleScheduler& operator = (const ParticleScheduler&) = delete;
+
+	// Take the script and run it until its first co_await
+	void start(ParticleScript script);
+
+	// Advance the time and resume the scripts, whose conditions fired
+	//
+	// Call it after the systems update, so allDead sees the particles,
+	// that have died within the step. The delays and the bursts, that
+	// the resumed scripts await, fire on the next update at the earliest,
+	// even the ones of zero seconds, so a script is resumed once per update
+	void update(float dt);
+
+	// Amount of the unfinished scripts
+	std::size_t getScriptCount() const;
+
+	struct Delay
+	{
+		float seconds;
+
+		bool await_ready() const noexcept { return seconds <= 0.0f; }
+		void await_suspend(ParticleScript::Handle handle) const;
+		void await_resume() const noexcept {}
+	};
+
+	struct Burst
+	{
+		ParticleSystem* system;
+		float           rate;
+		float           seconds;
+
+		bool await_ready() const noexcept { return false; }
+		void await_suspend(ParticleScript::Handle handle) const;
+		void await_resume() const noexcept {}
+	};
+
+	struct AllDead
+	{
+		ParticleSystem* system;
+
+		bool await_ready() const noexcept { return system->getParticleCount() == 0; }
+		void await_suspend(ParticleScript::Handle handle) const;
+		void await_resume() const noexcept {}
+	};
+
+private:
+	struct Timer
+	{
+		double                time;
+		ParticleScript::Handle handle;
+		ParticleSystem*       stop_emission; // for the bursts
+
+		bool operator < (const Timer& other) const { return time > other.time; } // min-heap
+	};
+
+	struct Waiters
+	{
+		ParticleSystem*                         system;
+		std::pmr::vector<ParticleScript::Handle> handles;
+	};
+
+	void addTimer(float seconds, ParticleScript::Handle handle, ParticleSystem* stop_emission);
+	void addWaiter(ParticleSystem* system, ParticleScript::Handle handle);
+	void resume(ParticleScript::Handle handle);
+
+	std::pmr::memory_resource*             m_resource;
+	std::pmr::vector<Timer>                m_timers;
+	std::pmr::vector<Timer>                m_deferred; // the timers added within update
+	std::pmr::vector<Waiters>              m_waiters;
+	std::pmr::vector<ParticleScript::Handle> m_ready; // scratch of update
+	double                                 m_time;
+	std::size_t                            m_script_count;
+	bool                                   m_is_updating;
+};
+
+inline ParticleScheduler::Delay delay(float seconds)
+{
+	return { seconds };
+}
+
+inline ParticleScheduler::Burst burst(ParticleSystem& system, float rate, float seconds)
+{
+	return { &system, rate, seconds };
+}
+
+inline ParticleScheduler::AllDead allDead(ParticleSystem& system)
+{
+	return { &system };
+}
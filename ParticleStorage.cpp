@@ -0,0 +1,373 @@
+#include "ParticleStorage.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+	constexpr std::size_t huge_page_size = 2 * 1024 * 1024;
+	constexpr std::size_t float_arrays = 9;
+	constexpr std::size_t fixed_arrays = 5;
+	constexpr std::size_t byte_arrays = 2;
+
+	std::size_t alignUp(std::size_t value, std::size_t alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+}
+
+ParticleStorage::ParticleStorage(std::pmr::memory_resource* resource) :
+	m_resource(resource),
+	m_block(nullptr),
+	m_block_size(0),
+	m_block_alignment(alignment),
+	m_size(0),
+	m_capacity(0),
+	m_huge_pages(false),
+	m_fixed_point(false),
+	m_birth_times(false)
+{
+}
+
+ParticleStorage::ParticleStorage(ParticleStorage&& other) noexcept :
+	m_resource(other.m_resource),
+	m_block(nullptr),
+	m_block_size(0),
+	m_block_alignment(alignment),
+	m_size(0),
+	m_capacity(0),
+	m_huge_pages(false),
+	m_fixed_point(false),
+	m_birth_times(false)
+{
+	take(other);
+}
+
+ParticleStorage& ParticleStorage::operator = (ParticleStorage&& other) noexcept
+{
+	if (this != &other)
+	{
+		release();
+		take(other);
+	}
+
+	return *this;
+}
+
+ParticleStorage::~ParticleStorage()
+{
+	release();
+}
+
+void ParticleStorage::setHugePages(bool enabled)
+{
+	m_huge_pages = enabled;
+}
+
+void ParticleStorage::setFixedPoint(bool enabled)
+{
+	if (m_fixed_point == enabled)
+		return;
+
+	m_fixed_point = enabled;
+
+	if (m_capacity)
+		reallocate(m_capacity);
+}
+
+void ParticleStorage::setBirthTimes(bool enabled)
+{
+	if (m_birth_times == enabled)
+		return;
+
+	m_birth_times = enabled;
+
+	if (m_capacity)
+		reallocate(m_capacity);
+}
+
+void ParticleStorage::reserve(std::size_t capacity)
+{
+	if (capacity > m_capacity)
+		reallocate(capacity);
+}
+
+void ParticleStorage::shrink(std::size_t capacity)
+{
+	capacity = alignUp(std::max(capacity, m_size), alignment);
+
+	if (capacity < m_capacity)
+		reallocate(capacity);
+}
+
+std::size_t ParticleStorage::push()
+{
+	if (m_size == m_capacity)
+		reallocate(std::max<std::size_t>(m_capacity * 2, alignment));
+
+	return m_size++;
+}
+
+std::size_t ParticleStorage::push(std::size_t count)
+{
+	if (m_size + count > m_capacity)
+		reallocate(std::max(m_capacity * 2, m_size + count));
+
+	std::size_t first = m_size;
+	m_size += count;
+
+	return first;
+}
+
+void ParticleStorage::remove(std::size_t index)
+{
+	std::size_t last = --m_size;
+
+	position_x[index]       = position_x[last];
+	position_y[index]       = position_y[last];
+	velocity_x[index]       = velocity_x[last];
+	velocity_y[index]       = velocity_y[last];
+	size_x[index]           = size_x[last];
+	size_y[index]           = size_y[last];
+	rotation[index]         = rotation[last];
+	angular_velocity[index] = angular_velocity[last];
+	lifetime[index]         = lifetime[last];
+	color_index[index]      = color_index[last];
+	sleep_frames[index]     = sleep_frames[last];
+
+	if (m_fixed_point)
+	{
+		fixed_position_x[index] = fixed_position_x[last];
+		fixed_position_y[index] = fixed_position_y[last];
+		fixed_velocity_x[index] = fixed_velocity_x[last];
+		fixed_velocity_y[index] = fixed_velocity_y[last];
+		fixed_lifetime[index]   = fixed_lifetime[last];
+	}
+
+	if (m_birth_times)
+		birth_time[index] = birth_time[last];
+}
+
+void ParticleStorage::swap(std::size_t first, std::size_t second)
+{
+	std::swap(position_x[first], position_x[second]);
+	std::swap(position_y[first], position_y[second]);
+	std::swap(velocity_x[first], velocity_x[second]);
+	std::swap(velocity_y[first], velocity_y[second]);
+	std::swap(size_x[first], size_x[second]);
+	std::swap(size_y[first], size_y[second]);
+	std::swap(rotation[first], rotation[second]);
+	std::swap(angular_velocity[first], angular_velocity[second]);
+	std::swap(lifetime[first], lifetime[second]);
+	std::swap(color_index[first], color_index[second]);
+	std::swap(sleep_frames[first], sleep_frames[second]);
+
+	if (m_fixed_point)
+	{
+		std::swap(fixed_position_x[first], fixed_position_x[second]);
+		std::swap(fixed_position_y[first], fixed_position_y[second]);
+		std::swap(fixed_velocity_x[first], fixed_velocity_x[second]);
+		std::swap(fixed_velocity_y[first], fixed_velocity_y[second]);
+		std::swap(fixed_lifetime[first], fixed_lifetime[second]);
+	}
+
+	if (m_birth_times)
+		std::swap(birth_time[first], birth_time[second]);
+}
+
+void ParticleStorage::clear()
+{
+	m_size = 0;
+}
+
+std::size_t ParticleStorage::getSize() const
+{
+	return m_size;
+}
+
+std::size_t ParticleStorage::getPaddedSize() const
+{
+	return alignUp(m_size, lanes);
+}
+
+std::size_t ParticleStorage::getCapacity() const
+{
+	return m_capacity;
+}
+
+std::size_t ParticleStorage::getMemoryUsage() const
+{
+	return m_block_size;
+}
+
+bool ParticleStorage::isHugePagesEnabled() const
+{
+	return m_huge_pages;
+}
+
+bool ParticleStorage::isFixedPoint() const
+{
+	return m_fixed_point;
+}
+
+bool ParticleStorage::isBirthTimesEnabled() const
+{
+	return m_birth_times;
+}
+
+std::pmr::memory_resource* ParticleStorage::getMemoryResource() const
+{
+	return m_resource;
+}
+
+void ParticleStorage::reallocate(std::size_t capacity)
+{
+	// The capacity is a multiple of the cache line even for the byte arrays,
+	// so every array that follows the previous one is aligned as well
+	capacity = alignUp(capacity, alignment);
+
+	// Every array is followed by a spare cache line: with the capacity
+	// of a large power of two multiple (and the huge pages, which keep
+	// the low bits of the physical addresses), the arrays would start
+	// at the same cache set and evict each other in the kernels
+	std::size_t stride = capacity + lanes;
+	std::size_t byte_stride = capacity + alignment;
+
+	std::size_t int_arrays = m_fixed_point ? fixed_arrays : 0;
+	std::size_t time_arrays = m_birth_times ? 1 : 0;
+	std::size_t block_size = stride * ((float_arrays + time_arrays) * sizeof(float) + int_arrays * sizeof(std::int32_t)) + byte_stride * byte_arrays;
+	std::size_t block_alignment = alignment;
+
+	if (m_huge_pages && block_size >= huge_page_size)
+	{
+		block_size = alignUp(block_size, huge_page_size);
+		block_alignment = huge_page_size;
+	}
+
+	void* block = m_resource->allocate(block_size, block_alignment);
+
+#if defined(__linux__)
+	if (block_alignment == huge_page_size)
+		madvise(block, block_size, MADV_HUGEPAGE);
+#endif
+
+	std::memset(block, 0, block_size);
+
+	float* arrays[float_arrays];
+	auto* cursor = static_cast<float*>(block);
+
+	for (auto& array : arrays)
+	{
+		array = cursor;
+		cursor += stride;
+	}
+
+	std::int32_t* ints[fixed_arrays] = {};
+	auto* int_cursor = reinterpret_cast<std::int32_t*>(cursor);
+
+	for (std::size_t i = 0; i < int_arrays; ++i)
+	{
+		ints[i] = int_cursor;
+		int_cursor += stride;
+	}
+
+	auto* time_cursor = reinterpret_cast<float*>(int_cursor);
+	float* times = time_arrays ? time_cursor : nullptr;
+	time_cursor += stride * time_arrays;
+
+	auto* bytes = reinterpret_cast<std::uint8_t*>(time_cursor);
+
+	if (m_size)
+	{
+		const float* old_arrays[float_arrays] = { position_x, position_y, velocity_x, velocity_y, size_x, size_y, rotation, angular_velocity, lifetime };
+
+		for (std::size_t i = 0; i < float_arrays; ++i)
+			std::memcpy(arrays[i], old_arrays[i], m_size * sizeof(float));
+
+		std::memcpy(bytes, color_index, m_size * sizeof(std::uint8_t));
+		std::memcpy(bytes + byte_stride, sleep_frames, m_size * sizeof(std::uint8_t));
+
+		// The fixed arrays are new, if the mode has just been enabled
+		const std::int32_t* old_ints[fixed_arrays] = { fixed_position_x, fixed_position_y, fixed_velocity_x, fixed_velocity_y, fixed_lifetime };
+
+		for (std::size_t i = 0; i < int_arrays; ++i)
+		{
+			if (old_ints[i])
+				std::memcpy(ints[i], old_ints[i], m_size * sizeof(std::int32_t));
+		}
+
+		if (times && birth_time)
+			std::memcpy(times, birth_time, m_size * sizeof(float));
+	}
+
+	release();
+
+	position_x       = arrays[0];
+	position_y       = arrays[1];
+	velocity_x       = arrays[2];
+	velocity_y       = arrays[3];
+	size_x           = arrays[4];
+	size_y           = arrays[5];
+	rotation         = arrays[6];
+	angular_velocity = arrays[7];
+	lifetime         = arrays[8];
+	color_index      = bytes;
+	sleep_frames     = bytes + byte_stride;
+	fixed_position_x = ints[0];
+	fixed_position_y = ints[1];
+	fixed_velocity_x = ints[2];
+	fixed_velocity_y = ints[3];
+	fixed_lifetime   = ints[4];
+	birth_time       = times;
+
+	m_block = block;
+	m_block_size = block_size;
+	m_block_alignment = block_alignment;
+	m_capacity = capacity;
+}
+
+// The block belongs to the resource of the other storage, so it comes along
+void ParticleStorage::take(ParticleStorage& other)
+{
+	position_x       = std::exchange(other.position_x, nullptr);
+	position_y       = std::exchange(other.position_y, nullptr);
+	velocity_x       = std::exchange(other.velocity_x, nullptr);
+	velocity_y       = std::exchange(other.velocity_y, nullptr);
+	size_x           = std::exchange(other.size_x, nullptr);
+	size_y           = std::exchange(other.size_y, nullptr);
+	rotation         = std::exchange(other.rotation, nullptr);
+	angular_velocity = std::exchange(other.angular_velocity, nullptr);
+	lifetime         = std::exchange(other.lifetime, nullptr);
+	fixed_position_x = std::exchange(other.fixed_position_x, nullptr);
+	fixed_position_y = std::exchange(other.fixed_position_y, nullptr);
+	fixed_velocity_x = std::exchange(other.fixed_velocity_x, nullptr);
+	fixed_velocity_y = std::exchange(other.fixed_velocity_y, nullptr);
+	fixed_lifetime   = std::exchange(other.fixed_lifetime, nullptr);
+	birth_time       = std::exchange(other.birth_time, nullptr);
+	color_index      = std::exchange(other.color_index, nullptr);
+	sleep_frames     = std::exchange(other.sleep_frames, nullptr);
+
+	m_resource        = other.m_resource;
+	m_block           = std::exchange(other.m_block, nullptr);
+	m_block_size      = std::exchange(other.m_block_size, 0);
+	m_block_alignment = std::exchange(other.m_block_alignment, alignment);
+	m_size            = std::exchange(other.m_size, 0);
+	m_capacity        = std::exchange(other.m_capacity, 0);
+	m_huge_pages      = other.m_huge_pages;
+	m_fixed_point     = other.m_fixed_point;
+	m_birth_times     = other.m_birth_times;
+}
+
+void ParticleStorage::release()
+{
+	if (m_block)
+		m_resource->deallocate(m_block, m_block_size, m_block_alignment);
+
+	m_block = nullptr;
+	m_block_size = 0;
+}
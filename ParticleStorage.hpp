@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+
+// Structure of arrays, that keeps the state of the particles
+//
+// All the attributes live in one memory block, every array
+// starts at a cache line boundary (64 bytes) and the capacity
+// is a multiple of the cache line, so the kernels can process
+// the arrays by whole vectors up to getPaddedSize() without
+// any tail loops. The padding lanes always hold finite values.
+//
+// Particles are not ordered: removing one moves the last
+// particle into the freed slot.
+//
+// The block is allocated from the memory resource, passed to
+// the constructor, which must outlive the storage. Moving the
+// storage hands over the block along with its resource.
+class ParticleStorage
+{
+public:
+	static constexpr std::size_t alignment = 64;
+	static constexpr std::size_t lanes = alignment / sizeof(float);
+
+	explicit ParticleStorage(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+	~ParticleStorage();
+
+	ParticleStorage(ParticleStorage&& other) noexcept;
+	ParticleStorage& operator = (ParticleStorage&& other) noexcept;
+
+	ParticleStorage(const ParticleStorage&) = delete;
+	ParticleStorage& operator = (const ParticleStorage&) = delete;
+
+	// Allow backing the large pools with transparent huge pages
+	//
+	// Only affects the allocations made after the call, and
+	// only on Linux, elsewhere it does nothing.
+	// By default is disabled
+	//
+	// See isHugePagesEnabled
+	void setHugePages(bool enabled);
+
+	// Allocate the fixed-point arrays along with the float ones
+	//
+	// The new arrays are zeroed, the owner fills them.
+	// By default is disabled
+	//
+	// See isFixedPoint
+	void setFixedPoint(bool enabled);
+
+	// Allocate the array of the birth times along with the others
+	//
+	// The new array is zeroed, the owner fills it.
+	// By default is disabled
+	//
+	// See isBirthTimesEnabled
+	void setBirthTimes(bool enabled);
+
+	// Make room for at least 'capacity' particles
+	//
+	// Never shrinks the storage, the existing particles are kept
+	void reserve(std::size_t capacity);
+
+	// Release the capacity above 'capacity' particles
+	//
+	// Never drops the existing particles
+	void shrink(std::size_t capacity);
+
+	// Append a particle and return its index
+	//
+	// The attributes of the new particle are undefined,
+	// the caller must write all of them
+	std::size_t push();
+
+	// Append 'count' particles and return the index of the first one,
+	// the new particles occupy [index, index + count)
+	std::size_t push(std::size_t count);
+
+	// Remove the particle, the last one takes its place
+	void remove(std::size_t index);
+
+	// Exchange two particles, used to keep the partitions
+	void swap(std::size_t first, std::size_t second);
+
+	void clear();
+
+	std::size_t getSize()       const;
+	std::size_t getPaddedSize() const;
+	std::size_t getCapacity()   const;
+	std::size_t getMemoryUsage() const;
+	bool        isHugePagesEnabled() const;
+	bool        isFixedPoint()       const;
+	bool        isBirthTimesEnabled() const;
+
+	std::pmr::memory_resource* getMemoryResource() const;
+
+	float* position_x       = nullptr;
+	float* position_y       = nullptr;
+	float* velocity_x       = nullptr;
+	float* velocity_y       = nullptr;
+	float* size_x           = nullptr;
+	float* size_y           = nullptr;
+	float* rotation         = nullptr; // in degrees
+	float* angular_velocity = nullptr; // in degrees per sec
+	float* lifetime         = nullptr;
+
+	// Q16.16, only with setFixedPoint(true)
+	std::int32_t* fixed_position_x = nullptr;
+	std::int32_t* fixed_position_y = nullptr;
+	std::int32_t* fixed_velocity_x = nullptr;
+	std::int32_t* fixed_velocity_y = nullptr;
+	std::int32_t* fixed_lifetime   = nullptr;
+
+	// Only with setBirthTimes(true)
+	float* birth_time = nullptr;
+
+	std::uint8_t* color_index  = nullptr;
+	std::uint8_t* sleep_frames = nullptr; // frames in a row below the sleep speed
+
+private:
+	void reallocate(std::size_t capacity);
+	void release();
+	void take(ParticleStorage& other);
+
+	std::pmr::memory_resource* m_resource;
+
+	void*       m_block;
+	std::size_t m_block_size;
+	std::size_t m_block_alignment;
+	std::size_t m_size;
+	std::size_t m_capacity;
+	bool        m_huge_pages;
+	bool        m_fixed_point;
+	bool        m_birth_times;
+};
@@ -1,72 +1,161 @@
 #define _USE_MATH_DEFINES
 
 #include "ParticleSystem.hpp"
-
-#include "Utils.hpp"
-
-#include <xstddef>
-
-// External random generators
-
-constexpr float inv_rand_max = 1.0f / RAND_MAX;
-
-float frand(float min, float max)
+#include "ParticleWorld.hpp"
+#include "ParticleProfiler.hpp"
+#include "FastMath.hpp"
+#include "FixedPoint.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+
+// Samples the range only when it isn't a constant
+void fillRange(ParticleRandom& random, float* values, std::size_t count, float min, float max)
 {
-	float fval = static_cast<float>(rand());
-
-	return (fval * inv_rand_max * (max - min) + min);
+	if (min == max)
+		std::fill(values, values + count, min);
+	else
+		random.fillUniform(values, count, min, max);
 }
 
-float frand(float bound)
+void fillRange(ParticleRandom& random, std::int32_t* values, std::size_t count, Fixed min, Fixed max)
 {
-	return frand(-bound, bound);
+	if (min == max)
+		std::fill(values, values + count, min);
+	else
+		random.fillFixed(values, count, min, max);
 }
 
-sf::Vector2f rand2f(const sf::Vector2f& factors)
+// Binary angle of the deterministic mode, 65536 units per turn
+std::int32_t toBinaryAngle(sf::Angle angle)
 {
-	return sf::Vector2f(frand(factors.x), frand(factors.y));
+	return toBinaryAngle(angle.asDegrees());
 }
 
-ParticleSystem::ParticleSystem() :
+// Every new system gets its own sequence by default
+std::atomic<std::uint32_t> next_seed(0x9E3779B9u);
+
+constexpr float deg_to_rad = static_cast<float>(M_PI) / 180.0f;
+
+ParticleSystem::ParticleSystem(std::pmr::memory_resource* resource) :
+	m_storage(resource),
+	m_palette(resource),
+	m_vertices(resource),
+	m_tag(resource),
+	m_high_water_mark(0),
+	m_sleeping(0),
+	m_cached_vertices(0),
+	m_behavior(nullptr),
+	m_behavior_scratch(resource),
+	m_world(nullptr),
+	m_node(nullptr),
+	m_node_version(0),
+	m_spawned(0),
+	m_histogram_time(0.0),
+	m_texture(nullptr),
+	m_color(sf::Color::White),
+	m_seed(next_seed++),
 	m_particle_size(32.0f, 32.0f), // Default size is 32x32 pixels
-	m_velocity(0.0f),
+	m_particle_size_max(32.0f, 32.0f),
 	m_exponential_growth(1.0f, 1.0f),
+	m_velocity(0.0f),
+	m_velocity_max(0.0f),
+	m_lifetime_min(0.0f),
 	m_lifetime_max(0.0f),
+	m_drag(0.0f),
+	m_sleep_speed(0.0f),
 	m_rate(0.0f),
+	m_time_scale(1.0f),
 	m_timer(0.0f),
+	m_fixed_timer(0),
+	m_shrink_delay(0.0f),
+	m_shrink_usage(0.25f),
+	m_shrink_timer(0.0f),
+	m_integrator(Integrator::SemiImplicitEuler),
+	m_sleep_frames(0),
 	m_is_emitted(false),
-	m_is_attenuated(false)
+	m_is_attenuated(false),
+	m_is_fast_math(false),
+	m_is_deterministic(false),
+	m_is_shrinking_vertices(false),
+	m_is_histograms_enabled(false),
+	m_is_idle(true),
+	m_is_skipped(true),
+	m_is_vertices_dirty(false)
 {
+	setSeed(m_seed);
 }
 
 void ParticleSystem::setTexture(const sf::Texture* texture)
 {
-	m_instance.setTexture(*texture);
+	m_texture = texture;
 	setParticleSize(sf::Vector2f(texture->getSize()));
-	m_instance.setOrigin(m_particle_size * 0.5f);
+	m_cached_vertices = 0;
+	m_is_vertices_dirty = true;
 }
 
 void ParticleSystem::setColor(const sf::Color& color)
 {
-	m_instance.setColor(color);
+	m_color = color;
+	m_cached_vertices = 0;
+	m_is_vertices_dirty = true;
+}
+
+void ParticleSystem::setPalette(const std::vector<sf::Color>& palette)
+{
+	std::size_t size = std::min<std::size_t>(palette.size(), 256);
+
+	m_palette.assign(palette.begin(), palette.begin() + size);
+	m_cached_vertices = 0;
+	m_is_vertices_dirty = true;
 }
 
 void ParticleSystem::setParticleSize(const sf::Vector2f& size)
 {
 	m_particle_size = size;
+	m_particle_size_max = size;
+}
 
-	setSize(m_instance, size);
-	m_instance.setOrigin(size * 0.5f);
+void ParticleSystem::setParticleSizeRange(const sf::Vector2f& min, const sf::Vector2f& max)
+{
+	setParticleSize(min);
+	m_particle_size_max = max;
 }
 
 void ParticleSystem::setEmitter(const sf::Vector2f& emitter)
 {
-	m_emitter = emitter;
+	if (m_node)
+	{
+		m_local_emitter = emitter;
+		m_node_version = 0;
+	}
+	else
+		m_emitter = emitter;
 }
 
 void ParticleSystem::setDirection(sf::Angle direction)
 {
-	m_direction = direction;
+	if (m_node)
+	{
+		m_local_direction = direction;
+		m_node_version = 0;
+	}
+	else
+		m_direction = direction;
+}
+
+void ParticleSystem::attach(const ParticleNode* node)
+{
+	if (node && !m_node)
+	{
+		m_local_emitter = m_emitter;
+		m_local_direction = m_direction;
+	}
+
+	m_node = node;
+	m_node_version = 0;
 }
 
 void ParticleSystem::setDispersion(sf::Angle dispersion)
@@ -77,6 +166,19 @@ void ParticleSystem::setDispersion(sf::Angle dispersion)
 void ParticleSystem::setVelocity(float velocity)
 {
 	m_velocity = fabs(velocity);
+	m_velocity_max = m_velocity;
+}
+
+void ParticleSystem::setVelocityRange(float min, float max)
+{
+	m_velocity = fabs(min);
+	m_velocity_max = fabs(max);
+}
+
+void ParticleSystem::setAngularVelocityRange(sf::Angle min, sf::Angle max)
+{
+	m_angular_velocity_min = min;
+	m_angular_velocity_max = max;
 }
 
 void ParticleSystem::setRespawnRate(float rate)
@@ -91,91 +193,554 @@ void ParticleSystem::setRespawnArea(const sf::Vector2f& area)
 
 void ParticleSystem::setLifeTime(float lifetime)
 {
+	m_lifetime_min = 0.0f;
 	m_lifetime_max = fabs(lifetime);
 }
 
+void ParticleSystem::setLifeTimeRange(float min, float max)
+{
+	m_lifetime_min = fabs(min);
+	m_lifetime_max = fabs(max);
+}
+
 void ParticleSystem::setExponentialGrowth(const sf::Vector2f& factors)
 {
 	m_exponential_growth = factors;
 }
 
+void ParticleSystem::setAcceleration(const sf::Vector2f& acceleration)
+{
+	m_acceleration = acceleration;
+	wakeUp();
+}
+
+void ParticleSystem::setDrag(float drag)
+{
+	m_drag = fabs(drag);
+	wakeUp();
+}
+
+void ParticleSystem::setIntegrator(Integrator integrator)
+{
+	m_integrator = integrator;
+}
+
+void ParticleSystem::setSleeping(float speed, std::size_t frames)
+{
+	m_sleep_speed = fabs(speed);
+	m_sleep_frames = static_cast<std::uint8_t>(std::min<std::size_t>(frames, 255));
+
+	if (m_sleep_frames == 0)
+		wakeUp();
+}
+
+void ParticleSystem::setBehavior(const ParticleExpression* expression)
+{
+	m_behavior = expression;
+
+	// The scratch is taken here, not in the middle of the game
+	if (expression && m_behavior_scratch.size() < expression->getScratchSize())
+		m_behavior_scratch.resize(expression->getScratchSize());
+}
+
+void ParticleSystem::setTimeScale(float scale)
+{
+	m_time_scale = std::max(scale, 0.0f);
+	m_is_skipped = m_is_idle || m_time_scale == 0.0f;
+}
+
+void ParticleSystem::wakeUp()
+{
+	std::fill(m_storage.sleep_frames, m_storage.sleep_frames + m_storage.getSize(), std::uint8_t(0));
+
+	m_sleeping = 0;
+	m_cached_vertices = 0;
+}
+
 void ParticleSystem::setEmitted(bool emitted)
 {
 	m_is_emitted = emitted;
+
+	if (emitted)
+		wake();
 }
 
 void ParticleSystem::setAttenuated(bool attenuation)
 {
 	m_is_attenuated = attenuation;
+	m_cached_vertices = 0;
+	m_is_vertices_dirty = true;
+}
+
+void ParticleSystem::setFastMath(bool fast)
+{
+	m_is_fast_math = fast;
+	m_cached_vertices = 0;
+	m_is_vertices_dirty = true;
+}
+
+void ParticleSystem::setDeterministic(bool deterministic)
+{
+	if (m_is_deterministic == deterministic)
+		return;
+
+	m_is_deterministic = deterministic;
+	m_storage.setFixedPoint(deterministic);
+
+	if (!deterministic)
+	{
+		m_timer = static_cast<float>(m_fixed_timer) / fixed_one;
+		return;
+	}
+
+	for (std::size_t i = 0; i < m_storage.getSize(); ++i)
+	{
+		m_storage.fixed_position_x[i] = toFixed(m_storage.position_x[i]);
+		m_storage.fixed_position_y[i] = toFixed(m_storage.position_y[i]);
+		m_storage.fixed_velocity_x[i] = toFixed(m_storage.velocity_x[i]);
+		m_storage.fixed_velocity_y[i] = toFixed(m_storage.velocity_y[i]);
+		m_storage.fixed_lifetime[i] = toFixed(m_storage.lifetime[i]);
+	}
+
+	m_fixed_timer = toFixed(m_timer);
 }
 
 void ParticleSystem::setExplosion(std::size_t splash_amount, float radius)
 {
-	if (m_particles.empty())
+	if (m_storage.getSize() == 0)
 	{
 		setEmitted(false);
+		resolveAttachment();
+
+		m_storage.reserve(splash_amount);
+
+		std::size_t first = m_storage.push(splash_amount);
+
+		wake();
+
+		if (m_is_deterministic)
+		{
+			explodeFixed(first, splash_amount, radius);
+			initParticles(first, splash_amount);
+
+			reserveVertices();
+			updateHighWaterMarks();
+			m_is_vertices_dirty = true;
+
+			return;
+		}
+
+		float* velocity_x = m_storage.velocity_x + first;
+		float* velocity_y = m_storage.velocity_y + first;
+
+		// The speeds go to velocity_x first, then get the direction
+		fillRange(m_random, velocity_x, splash_amount, m_velocity, m_velocity_max);
 
 		float offset = M_PI * 2 / splash_amount;
 
 		for (size_t i = 0; i < splash_amount; ++i)
 		{
-			auto particle = std::make_unique<Particle>();
-			memcpy(&particle->sprite, &m_instance, sizeof(sf::Sprite));
-
 			float dir = i * offset;
-			float sine = std::sin(dir);
-			float cosine = std::cos(dir);
+			float sine, cosine;
+			sinCos(dir, sine, cosine);
 
-			float x = cosine * radius + m_emitter.x;
-			float y = sine * radius + m_emitter.y;
+			std::size_t index = first + i;
 
-			particle->sprite.setPosition(sf::Vector2f(x, y));
+			m_storage.position_x[index] = cosine * radius + m_emitter.x;
+			m_storage.position_y[index] = sine * radius + m_emitter.y;
+			m_storage.rotation[index] = 0.0f;
 
-			particle->controller.velocity.x = cosine * m_velocity;
-			particle->controller.velocity.y = sine * m_velocity;
-			particle->controller.lifetime = frand(0, m_lifetime_max) + 1.0f;			
+			float velocity = velocity_x[i];
 
-			m_particles.push_back(std::move(particle));
+			velocity_x[i] = cosine * velocity;
+			velocity_y[i] = sine * velocity;
 		}
+
+		initParticles(first, splash_amount);
+
+		reserveVertices();
+		updateHighWaterMarks();
+		m_is_vertices_dirty = true;
 	}	
 }
 
+void ParticleSystem::setSeed(std::uint32_t seed)
+{
+	m_seed = seed;
+	m_random.setSeed(seed);
+}
+
+void ParticleSystem::setTag(std::string_view tag)
+{
+	m_tag = tag;
+}
+
+void ParticleSystem::resetCost()
+{
+	m_cost = Cost();
+}
+
+void ParticleSystem::setHugePages(bool enabled)
+{
+	m_storage.setHugePages(enabled);
+}
+
+void ParticleSystem::reserve(std::size_t amount)
+{
+	m_storage.reserve(amount);
+	reserveVertices();
+	updateHighWaterMarks();
+	wake();
+}
+
+void ParticleSystem::setShrinkPolicy(float delay, float usage)
+{
+	// At the half and above the particles wouldn't fit into
+	// the halved storage, and it would grow back at once
+	m_shrink_delay = fabs(delay);
+	m_shrink_usage = std::clamp(usage, 0.0f, std::nextafter(0.5f, 0.0f));
+	m_shrink_timer = 0.0f;
+	wake();
+}
+
+void ParticleSystem::setHistograms(bool enabled, float max_lifetime, float max_population, float max_spawns)
+{
+	m_is_histograms_enabled = enabled;
+
+#if PARTICLE_SYSTEM_INSTRUMENTATION
+	m_storage.setBirthTimes(enabled);
+#endif
+
+	if (enabled)
+	{
+		m_lifetime_histogram.setRange(0.0f, max_lifetime);
+		m_population_histogram.setRange(0.0f, max_population);
+		m_spawn_histogram.setRange(0.0f, max_spawns);
+		m_spawned = 0;
+
+#if PARTICLE_SYSTEM_INSTRUMENTATION
+		// The ages of the particles, that are alive already, are unknown
+		std::fill(m_storage.birth_time, m_storage.birth_time + m_storage.getSize(), -1.0f);
+#endif
+	}
+}
+
 void ParticleSystem::update(float dt)
 {
-	if (m_is_emitted)
-		m_timer += m_rate * dt;
+	if (m_is_skipped)
+		return;
+
+	dt *= m_time_scale;
+
+	if (!m_world)
+		resolveAttachment();
+
+	PARTICLE_PROFILE_SCOPE("update");
+
+	PARTICLE_COST_SCOPE(m_cost.update_time);
+
+	emitParticles(dt);
+	integrate(dt);
+	runBehavior(dt);
+
+#if PARTICLE_SYSTEM_INSTRUMENTATION
+	m_histogram_time += dt;
+#endif
 
-	while (m_timer > 1.0f)
+	compact();
+	shrink(dt);
+
+	m_is_vertices_dirty = true;
+	m_is_idle = !isActive();
+	m_is_skipped = m_is_idle;
+
+#if PARTICLE_SYSTEM_INSTRUMENTATION
+	m_cost.particle_seconds += m_storage.getSize() * dt;
+
+	if (m_is_histograms_enabled)
 	{
-		m_timer -= 1.0f;
-		createParticle();
+		m_population_histogram.add(static_cast<float>(m_storage.getSize()));
+		m_spawn_histogram.add(static_cast<float>(m_spawned));
+		m_spawned = 0;
 	}
+#endif
+}
+
+void ParticleSystem::emitParticles(float dt)
+{
+	PARTICLE_PROFILE_SCOPE("spawn");
+
+	PARTICLE_COST_SCOPE(m_cost.spawn_time);
 
-	for (auto p = m_particles.begin(); p != m_particles.end();)
+	// All the particles of the step are spawned as one batch
+	if (m_is_deterministic)
 	{
-		auto particle = (*p).get();		
+		// The rate isn't limited by the range of Fixed here
+		if (m_is_emitted)
+			m_fixed_timer += (std::llround(m_rate * fixed_one) * toFixed(dt)) >> fixed_shift;
 
-		if (particle->controller.lifetime > 0.0f)
+		if (m_fixed_timer > fixed_one)
 		{
-			particle->sprite.move(particle->controller.velocity * dt);
+			auto count = static_cast<std::size_t>((m_fixed_timer - 1) >> fixed_shift);
 
-			float ratio = particle->controller.lifetime / m_lifetime_max;
+			m_fixed_timer -= static_cast<std::int64_t>(count) << fixed_shift;
+			createParticles(count);
+		}
+	}
+	else
+	{
+		if (m_is_emitted)
+			m_timer += m_rate * dt;
 
-			if (m_is_attenuated)
-			{
-				sf::Color color = particle->sprite.getColor();
-				color.a = static_cast<sf::Uint8>(ratio * 255);
-				particle->sprite.setColor(color);
-			}		
+		if (m_timer > 1.0f)
+		{
+			auto count = static_cast<std::size_t>(std::ceil(m_timer - 1.0f));
+
+			m_timer -= static_cast<float>(count);
+			createParticles(count);
+		}
+	}
+
+	reserveVertices();
+	updateHighWaterMarks();
+}
+
+void ParticleSystem::integrate(float dt)
+{
+	PARTICLE_PROFILE_SCOPE("integrate");
+
+	PARTICLE_COST_SCOPE(m_cost.integrate_time);
+
+	// The sleepers would be moved by the growth or the rotation
+	bool is_static = m_exponential_growth == sf::Vector2f(1.0f, 1.0f)
+		&& m_angular_velocity_min == sf::Angle::Zero && m_angular_velocity_max == sf::Angle::Zero;
 
-			particle->sprite.scale(m_exponential_growth);		
+	if (m_sleeping && !is_static)
+		wakeUp();
 
-			p++;
+	// The arrays are padded up to the whole vectors,
+	// so the loops below don't need any tail handling
+	std::size_t count = m_storage.getPaddedSize();
+	std::size_t first = m_sleeping;
+
+	if (m_is_deterministic)
+		moveFixed(dt, first, count);
+	else
+		move(dt, first, count);
+
+	float* rotation = m_storage.rotation;
+
+	if (m_angular_velocity_min != m_angular_velocity_max)
+	{
+		const float* angular_velocity = m_storage.angular_velocity;
+
+		for (std::size_t i = first; i < count; ++i)
+			rotation[i] += angular_velocity[i] * dt;
+	}
+	else if (m_angular_velocity_min != sf::Angle::Zero)
+	{
+		float step = m_angular_velocity_min.asDegrees() * dt;
+
+		for (std::size_t i = first; i < count; ++i)
+			rotation[i] += step;
+	}
+
+	if (m_sleep_frames && is_static)
+		fallAsleep();
+}
+
+void ParticleSystem::move(float dt, std::size_t first, std::size_t count)
+{
+	float* position_x = m_storage.position_x;
+	float* position_y = m_storage.position_y;
+	float* velocity_x = m_storage.velocity_x;
+	float* velocity_y = m_storage.velocity_y;
+	float* size_x     = m_storage.size_x;
+	float* size_y     = m_storage.size_y;
+	float* lifetime   = m_storage.lifetime;
+
+	// Only the lifetime of the sleepers runs
+	for (std::size_t i = 0; i < count; ++i)
+		lifetime[i] -= dt;
+
+	// Both schemes are linear in the velocity and the acceleration:
+	// position += velocity * move + acceleration * push
+	// velocity  = velocity * damping + acceleration * kick
+	// with the factors, that are the same for all the particles,
+	// so the exponent is taken once per update and libm costs nothing
+	float k = m_drag * dt;
+	float damping = std::exp(-k);
+	float move, push, kick;
+
+	if (m_integrator == Integrator::Exact)
+	{
+		// move = (1 - e^-k) / drag, push = (dt - move) / drag,
+		// the series avoid the cancellation for the small drag
+		if (k < 1e-3f)
+		{
+			move = dt * (1.0f - k * (0.5f - k * (1.0f / 6.0f)));
+			push = dt * dt * (0.5f - k * (1.0f / 6.0f - k * (1.0f / 24.0f)));
 		}
 		else
-			p = m_particles.erase(p);
+		{
+			move = (1.0f - damping) / m_drag;
+			push = (dt - move) / m_drag;
+		}
 
-		particle->controller.lifetime -= dt;
+		kick = move;
+	}
+	else
+	{
+		move = damping * dt;
+		push = dt * dt;
+		kick = dt;
+	}
+
+	sf::Vector2f push_step = m_acceleration * push;
+	sf::Vector2f kick_step = m_acceleration * kick;
+
+	for (std::size_t i = first; i < count; ++i)
+	{
+		position_x[i] += velocity_x[i] * move + push_step.x;
+		position_y[i] += velocity_y[i] * move + push_step.y;
+		velocity_x[i] = velocity_x[i] * damping + kick_step.x;
+		velocity_y[i] = velocity_y[i] * damping + kick_step.y;
+		size_x[i] *= m_exponential_growth.x;
+		size_y[i] *= m_exponential_growth.y;
+	}
+}
+
+void ParticleSystem::moveFixed(float dt, std::size_t first, std::size_t count)
+{
+	std::int32_t* position_x = m_storage.fixed_position_x;
+	std::int32_t* position_y = m_storage.fixed_position_y;
+	std::int32_t* velocity_x = m_storage.fixed_velocity_x;
+	std::int32_t* velocity_y = m_storage.fixed_velocity_y;
+	std::int32_t* lifetime   = m_storage.fixed_lifetime;
+	float* size_x = m_storage.size_x;
+	float* size_y = m_storage.size_y;
+
+	Fixed step = toFixed(dt);
+
+	// Only the lifetime of the sleepers runs
+	for (std::size_t i = 0; i < count; ++i)
+		lifetime[i] = fixedAdd(lifetime[i], -step);
+
+	// Semi-implicit Euler, the exponent of the exact drag
+	// isn't reproducible without the libm
+	Fixed damping = std::max(0, fixed_one - fixedMul(toFixed(m_drag), step));
+	Fixed kick_x = fixedMul(toFixed(m_acceleration.x), step);
+	Fixed kick_y = fixedMul(toFixed(m_acceleration.y), step);
+
+	for (std::size_t i = first; i < count; ++i)
+	{
+		velocity_x[i] = fixedAddSaturated(fixedMul(velocity_x[i], damping), kick_x);
+		velocity_y[i] = fixedAddSaturated(fixedMul(velocity_y[i], damping), kick_y);
+		position_x[i] = fixedAdd(position_x[i], fixedMul(velocity_x[i], step));
+		position_y[i] = fixedAdd(position_y[i], fixedMul(velocity_y[i], step));
+		size_x[i] *= m_exponential_growth.x;
+		size_y[i] *= m_exponential_growth.y;
+	}
+
+	syncFixed(0, count);
+}
+
+void ParticleSystem::fallAsleep()
+{
+	PARTICLE_PROFILE_SCOPE("sleep");
+
+	std::size_t count = m_storage.getSize();
+
+	const float* velocity_x = m_storage.velocity_x;
+	const float* velocity_y = m_storage.velocity_y;
+	std::uint8_t* sleep_frames = m_storage.sleep_frames;
+
+	float limit = m_sleep_speed * m_sleep_speed;
+
+	for (std::size_t i = m_sleeping; i < count; ++i)
+	{
+		bool is_calm = velocity_x[i] * velocity_x[i] + velocity_y[i] * velocity_y[i] < limit;
+		std::uint8_t frames = std::min<std::uint8_t>(sleep_frames[i], m_sleep_frames - 1);
+
+		sleep_frames[i] = is_calm ? frames + 1 : 0;
+	}
+
+	// The new sleepers go to the end of the partition, so
+	// the cached vertices of the old ones stay valid
+	for (std::size_t i = m_sleeping; i < count; ++i)
+	{
+		if (sleep_frames[i] >= m_sleep_frames)
+			m_storage.swap(i, m_sleeping++);
+	}
+}
+
+void ParticleSystem::runBehavior(float dt)
+{
+	if (!m_behavior || m_is_deterministic)
+		return;
+
+	PARTICLE_PROFILE_SCOPE("behavior");
+
+	PARTICLE_COST_SCOPE(m_cost.behavior_time);
+
+	// Grows only if the expression is recompiled into a larger one
+	std::size_t scratch = m_behavior->getScratchSize();
+
+	if (m_behavior_scratch.size() < scratch)
+		m_behavior_scratch.resize(scratch);
+
+	m_behavior->run(m_storage, m_sleeping, m_storage.getSize() - m_sleeping, dt, m_behavior_scratch.data());
+}
+
+void ParticleSystem::compact()
+{
+	PARTICLE_PROFILE_SCOPE("compaction");
+
+	PARTICLE_COST_SCOPE(m_cost.compaction_time);
+
+	const float* lifetime = m_storage.lifetime;
+
+	for (std::size_t i = 0; i < m_storage.getSize();)
+	{
+		if (lifetime[i] > 0.0f)
+		{
+			++i;
+			continue;
+		}
+
+#if PARTICLE_SYSTEM_INSTRUMENTATION
+		// The behavior may have changed the lifetime, so the age is taken here
+		if (m_is_histograms_enabled && m_storage.birth_time[i] >= 0.0f)
+			m_lifetime_histogram.add(static_cast<float>(m_histogram_time - m_storage.birth_time[i]));
+#endif
+
+		// A dead sleeper goes to the end of the sleepers, then it is
+		// removed from the head of the awake ones. On its way it passes
+		// the last cached one, which takes its place with the quad,
+		// so the cache loses a single particle
+		if (i < m_sleeping)
+		{
+			std::size_t last = --m_sleeping;
+
+			if (i < m_cached_vertices)
+			{
+				std::size_t cached = --m_cached_vertices;
+
+				if (i != cached)
+				{
+					m_storage.swap(i, cached);
+					std::copy_n(&m_vertices[cached * 6], 6, &m_vertices[i * 6]);
+				}
+
+				m_storage.swap(cached, last);
+			}
+			else
+				m_storage.swap(i, last);
+
+			m_storage.remove(last);
+		}
+		else
+			m_storage.remove(i);
 	}
 }
 
@@ -183,12 +748,17 @@ void ParticleSystem::update(float dt)
 
 const sf::Texture* ParticleSystem::getTexture() const
 {
-	return m_instance.getTexture();
+	return m_texture;
 }
 
 const sf::Color& ParticleSystem::getColor() const
 {
-	return m_instance.getColor();
+	return m_color;
+}
+
+const std::pmr::vector<sf::Color>& ParticleSystem::getPalette() const
+{
+	return m_palette;
 }
 
 const sf::Vector2f& ParticleSystem::getParticleSize() const
@@ -196,6 +766,16 @@ const sf::Vector2f& ParticleSystem::getParticleSize() const
 	return m_particle_size;
 }
 
+std::pair<sf::Vector2f, sf::Vector2f> ParticleSystem::getParticleSizeRange() const
+{
+	return { m_particle_size, m_particle_size_max };
+}
+
+const ParticleNode* ParticleSystem::getNode() const
+{
+	return m_node;
+}
+
 const sf::Vector2f& ParticleSystem::getEmitter() const
 {
 	return m_emitter;
@@ -216,6 +796,16 @@ float ParticleSystem::getVelocity() const
 	return m_velocity;
 }
 
+std::pair<float, float> ParticleSystem::getVelocityRange() const
+{
+	return { m_velocity, m_velocity_max };
+}
+
+std::pair<sf::Angle, sf::Angle> ParticleSystem::getAngularVelocityRange() const
+{
+	return { m_angular_velocity_min, m_angular_velocity_max };
+}
+
 float ParticleSystem::getRespawnRate() const
 {
 	return m_rate;
@@ -231,11 +821,120 @@ float ParticleSystem::getLifeTime() const
 	return m_lifetime_max;
 }
 
+std::pair<float, float> ParticleSystem::getLifeTimeRange() const
+{
+	return { m_lifetime_min, m_lifetime_max };
+}
+
 const sf::Vector2f& ParticleSystem::getExponentialGrowth() const
 {
 	return m_exponential_growth;
 }
 
+const sf::Vector2f& ParticleSystem::getAcceleration() const
+{
+	return m_acceleration;
+}
+
+float ParticleSystem::getTimeScale() const
+{
+	return m_time_scale;
+}
+
+float ParticleSystem::getDrag() const
+{
+	return m_drag;
+}
+
+ParticleSystem::Integrator ParticleSystem::getIntegrator() const
+{
+	return m_integrator;
+}
+
+const ParticleExpression* ParticleSystem::getBehavior() const
+{
+	return m_behavior;
+}
+
+std::size_t ParticleSystem::getParticleCount() const
+{
+	return m_storage.getSize();
+}
+
+std::size_t ParticleSystem::getSleepingCount() const
+{
+	return m_sleeping;
+}
+
+const std::pmr::vector<sf::Vertex>& ParticleSystem::getVertices() const
+{
+	if (m_is_vertices_dirty)
+		updateVertices();
+
+	return m_vertices;
+}
+
+std::uint32_t ParticleSystem::getSeed() const
+{
+	return m_seed;
+}
+
+std::size_t ParticleSystem::MemoryUsage::getTotal() const
+{
+	return particles + vertices + palette;
+}
+
+ParticleSystem::MemoryUsage ParticleSystem::getMemoryUsage() const
+{
+	MemoryUsage usage;
+
+	usage.particles = m_storage.getMemoryUsage();
+	usage.vertices = m_vertices.capacity() * sizeof(sf::Vertex);
+	usage.palette = m_palette.capacity() * sizeof(sf::Color);
+
+	return usage;
+}
+
+ParticleSystem::MemoryUsage ParticleSystem::getPeakMemoryUsage() const
+{
+	return m_peak_memory;
+}
+
+std::size_t ParticleSystem::getHighWaterMark() const
+{
+	return m_high_water_mark;
+}
+
+const ParticleHistogram& ParticleSystem::getLifetimeHistogram() const
+{
+	return m_lifetime_histogram;
+}
+
+const ParticleHistogram& ParticleSystem::getPopulationHistogram() const
+{
+	return m_population_histogram;
+}
+
+const ParticleHistogram& ParticleSystem::getSpawnHistogram() const
+{
+	return m_spawn_histogram;
+}
+
+bool ParticleSystem::isHistogramsEnabled() const
+{
+	return m_is_histograms_enabled;
+}
+
+const std::pmr::string& ParticleSystem::getTag() const
+{
+	return m_tag;
+}
+
+const ParticleSystem::Cost& ParticleSystem::getCost() const
+{
+	return m_cost;
+}
+
 bool ParticleSystem::isEmitted() const
 {
 	return m_is_emitted;
@@ -246,42 +945,412 @@ bool ParticleSystem::isAttenuated() const
 	return m_is_attenuated;
 }
 
+bool ParticleSystem::isFastMath() const
+{
+	return m_is_fast_math;
+}
+
+bool ParticleSystem::isDeterministic() const
+{
+	return m_is_deterministic;
+}
+
+bool ParticleSystem::isIdle() const
+{
+	return m_is_idle;
+}
+
+bool ParticleSystem::isHugePagesEnabled() const
+{
+	return m_storage.isHugePagesEnabled();
+}
+
+std::pmr::memory_resource* ParticleSystem::getMemoryResource() const
+{
+	return m_storage.getMemoryResource();
+}
+
 void ParticleSystem::draw(sf::RenderTarget& target, const sf::RenderStates& states) const
 {
-	for (auto& particle : m_particles)
-		target.draw(particle->sprite);
+	PARTICLE_PROFILE_SCOPE("draw");
+
+	PARTICLE_COST_SCOPE(m_cost.draw_time);
+
+	const auto& vertices = getVertices();
+
+	sf::RenderStates render_states(states);
+	render_states.texture = m_texture;
+
+	target.draw(vertices.data(), vertices.size(), sf::PrimitiveType::Triangles, render_states);
+}
+
+void ParticleSystem::wake()
+{
+	if (!m_is_idle)
+		return;
+
+	m_is_idle = false;
+	m_is_skipped = m_time_scale == 0.0f;
+
+	if (m_world)
+		m_world->activate(this);
+}
+
+// Whether the next update has anything to do
+bool ParticleSystem::isActive() const
+{
+	if (m_storage.getSize() || m_is_emitted || m_is_shrinking_vertices)
+		return true;
+
+	return m_shrink_delay > 0.0f && m_storage.getCapacity() > ParticleStorage::alignment;
 }
 
-void ParticleSystem::createParticle()
+void ParticleSystem::resolveAttachment()
 {
-	auto particle = std::make_unique<Particle>();
-	memcpy(&particle->sprite, &m_instance, sizeof(sf::Sprite));
+	if (!m_node)
+		return;
+
+	std::uint32_t version = m_node->getVersion();
 
-	float half_disp = (m_dispersion * 0.5f).asDegrees();
-	float random = frand(-half_disp, half_disp);
-	float angle = (m_direction + sf::degrees(random)).asRadians();
+	if (version == m_node_version)
+		return;
 
-	particle->controller.velocity.x = std::cos(angle) * m_velocity;
-	particle->controller.velocity.y = std::sin(angle) * m_velocity;
+	m_node_version = version;
 
-	particle->controller.lifetime = frand(0, m_lifetime_max) + 1.0f;
+	// The libm and the floats differ between the machines,
+	// so the lockstep peers resolve the node in the integers
+	if (m_is_deterministic)
+	{
+		Fixed x = toFixed(m_local_emitter.x);
+		Fixed y = toFixed(m_local_emitter.y);
+		m_node->transformPointFixed(x, y);
 
-	sf::Vector2f respawn_point = rand2f(m_respawn_area);
-	sf::Vector2f offset = m_emitter + respawn_point;
+		auto direction = static_cast<std::uint32_t>(toBinaryAngle(m_local_direction));
+		direction = m_node->transformDirectionFixed(direction);
 
-	particle->sprite.setPosition(offset);
-	particle->sprite.setRotation(sf::degrees(frand(0.0f, 360.0f)));
+		// The round trip through the floats rounds alike on every machine
+		m_emitter = sf::Vector2f(toFloat(x), toFloat(y));
+		m_direction = sf::degrees(static_cast<float>(direction & 0xFFFF) * (360.0f / 65536.0f));
 
-	m_particles.push_back(std::move(particle));
+		return;
+	}
+
+	// The direction is transformed as a vector, so the scale
+	// and the mirroring of the node bend it as well
+	float angle = m_local_direction.asRadians();
+	sf::Vector2f direction = m_node->transformDirection(sf::Vector2f(std::cos(angle), std::sin(angle)));
+
+	m_emitter = m_node->transformPoint(m_local_emitter);
+	m_direction = sf::radians(std::atan2(direction.y, direction.x));
 }
 
-void ParticleSystem::setSize(sf::Sprite& sprite, const sf::Vector2f& size)
+void ParticleSystem::createParticles(std::size_t count)
 {
-	if (auto& rect = sprite.getTextureRect(); rect.width && rect.height)
+	std::size_t first = m_storage.push(count);
+
+	if (m_is_deterministic)
+		spawnFixed(first, count);
+	else
 	{
-		float width = size.x / std::abs(rect.width);
-		float height = size.y / std::abs(rect.height);
+		float* velocity_x = m_storage.velocity_x + first;
+		float* velocity_y = m_storage.velocity_y + first;
 
-		sprite.setScale(sf::Vector2f(width, height));
+		// The angles go to velocity_x and the speeds to velocity_y first,
+		// then both are turned into the velocities in place
+		float half_disp = (m_dispersion * 0.5f).asRadians();
+		float direction = m_direction.asRadians();
+
+		m_random.fillUniform(velocity_x, count, direction - half_disp, direction + half_disp);
+		fillRange(m_random, velocity_y, count, m_velocity, m_velocity_max);
+
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			float sine, cosine;
+			sinCos(velocity_x[i], sine, cosine);
+
+			float velocity = velocity_y[i];
+
+			velocity_x[i] = cosine * velocity;
+			velocity_y[i] = sine * velocity;
+		}
+
+		m_random.fillUniform(m_storage.position_x + first, count, m_emitter.x - m_respawn_area.x, m_emitter.x + m_respawn_area.x);
+		m_random.fillUniform(m_storage.position_y + first, count, m_emitter.y - m_respawn_area.y, m_emitter.y + m_respawn_area.y);
 	}
+
+	m_random.fillUniform(m_storage.rotation + first, count, 0.0f, 360.0f);
+
+	initParticles(first, count);
+}
+
+void ParticleSystem::spawnFixed(std::size_t first, std::size_t count)
+{
+	std::int32_t* velocity_x = m_storage.fixed_velocity_x + first;
+	std::int32_t* velocity_y = m_storage.fixed_velocity_y + first;
+
+	// The binary angles go to velocity_x and the speeds to velocity_y first.
+	// Both are brought to a turn, so the bounds can't overflow
+	std::int32_t direction = toBinaryAngle(m_direction) & 0xFFFF;
+	std::int32_t half_disp = std::clamp(toBinaryAngle(m_dispersion) / 2, -32768, 32768);
+
+	m_random.fillFixed(velocity_x, count, direction - half_disp, direction + half_disp);
+	fillRange(m_random, velocity_y, count, toFixed(m_velocity), toFixed(m_velocity_max));
+
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		Fixed sine, cosine;
+		fixedSinCos(static_cast<std::uint32_t>(velocity_x[i]), sine, cosine);
+
+		Fixed velocity = velocity_y[i];
+
+		velocity_x[i] = fixedMul(cosine, velocity);
+		velocity_y[i] = fixedMul(sine, velocity);
+	}
+
+	Fixed emitter_x = toFixed(m_emitter.x);
+	Fixed emitter_y = toFixed(m_emitter.y);
+	Fixed area_x = toFixed(m_respawn_area.x);
+	Fixed area_y = toFixed(m_respawn_area.y);
+
+	// The bounds saturate, so the range doesn't turn inside out at the edge
+	m_random.fillFixed(m_storage.fixed_position_x + first, count, fixedAddSaturated(emitter_x, -area_x), fixedAddSaturated(emitter_x, area_x));
+	m_random.fillFixed(m_storage.fixed_position_y + first, count, fixedAddSaturated(emitter_y, -area_y), fixedAddSaturated(emitter_y, area_y));
+}
+
+void ParticleSystem::explodeFixed(std::size_t first, std::size_t count, float radius)
+{
+	std::int32_t* velocity_x = m_storage.fixed_velocity_x + first;
+	std::int32_t* velocity_y = m_storage.fixed_velocity_y + first;
+
+	// The speeds go to velocity_x first, then get the direction
+	fillRange(m_random, velocity_x, count, toFixed(m_velocity), toFixed(m_velocity_max));
+
+	Fixed emitter_x = toFixed(m_emitter.x);
+	Fixed emitter_y = toFixed(m_emitter.y);
+	Fixed fixed_radius = toFixed(radius);
+
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		auto angle = static_cast<std::uint32_t>(i * 65536 / count);
+
+		Fixed sine, cosine;
+		fixedSinCos(angle, sine, cosine);
+
+		std::size_t index = first + i;
+
+		m_storage.fixed_position_x[index] = fixedAdd(emitter_x, fixedMul(cosine, fixed_radius));
+		m_storage.fixed_position_y[index] = fixedAdd(emitter_y, fixedMul(sine, fixed_radius));
+		m_storage.rotation[index] = 0.0f;
+
+		Fixed velocity = velocity_x[i];
+
+		velocity_x[i] = fixedMul(cosine, velocity);
+		velocity_y[i] = fixedMul(sine, velocity);
+	}
+}
+
+void ParticleSystem::syncFixed(std::size_t first, std::size_t count)
+{
+	for (std::size_t i = first; i < first + count; ++i)
+	{
+		m_storage.position_x[i] = toFloat(m_storage.fixed_position_x[i]);
+		m_storage.position_y[i] = toFloat(m_storage.fixed_position_y[i]);
+		m_storage.velocity_x[i] = toFloat(m_storage.fixed_velocity_x[i]);
+		m_storage.velocity_y[i] = toFloat(m_storage.fixed_velocity_y[i]);
+		m_storage.lifetime[i] = toFloat(m_storage.fixed_lifetime[i]);
+	}
+}
+
+void ParticleSystem::initParticles(std::size_t first, std::size_t count)
+{
+	float* lifetime = m_storage.lifetime + first;
+	float* size_x = m_storage.size_x + first;
+	float* size_y = m_storage.size_y + first;
+
+	if (m_is_deterministic)
+	{
+		fillRange(m_random, m_storage.fixed_lifetime + first, count, toFixed(m_lifetime_min + 1.0f), toFixed(m_lifetime_max + 1.0f));
+		syncFixed(first, count);
+	}
+	else
+		fillRange(m_random, lifetime, count, m_lifetime_min + 1.0f, m_lifetime_max + 1.0f);
+
+	fillRange(m_random, m_storage.angular_velocity + first, count, m_angular_velocity_min.asDegrees(), m_angular_velocity_max.asDegrees());
+
+	if (m_particle_size != m_particle_size_max)
+	{
+		// One random factor scales both sides, so the aspect is kept
+		sf::Vector2f delta = m_particle_size_max - m_particle_size;
+
+		m_random.fillUniform(size_x, count, 0.0f, 1.0f);
+
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			float factor = size_x[i];
+
+			size_x[i] = m_particle_size.x + delta.x * factor;
+			size_y[i] = m_particle_size.y + delta.y * factor;
+		}
+	}
+	else
+	{
+		std::fill(size_x, size_x + count, m_particle_size.x);
+		std::fill(size_y, size_y + count, m_particle_size.y);
+	}
+
+	std::uint8_t* color_index = m_storage.color_index + first;
+
+	if (m_palette.empty())
+		std::fill(color_index, color_index + count, std::uint8_t(0));
+	else
+		for (std::size_t i = 0; i < count; ++i)
+			color_index[i] = static_cast<std::uint8_t>(m_random.next() % m_palette.size());
+
+	std::fill(m_storage.sleep_frames + first, m_storage.sleep_frames + first + count, std::uint8_t(0));
+
+#if PARTICLE_SYSTEM_INSTRUMENTATION
+	if (m_is_histograms_enabled)
+	{
+		std::fill(m_storage.birth_time + first, m_storage.birth_time + first + count, static_cast<float>(m_histogram_time));
+		m_spawned += count;
+	}
+#endif
+}
+
+void ParticleSystem::reserveVertices()
+{
+	// The vertex batch follows the storage growth here, so the draw
+	// call only rewrites the vertices and never allocates
+	std::size_t capacity = m_storage.getCapacity() * 6;
+
+	if (m_vertices.capacity() < capacity)
+		m_vertices.reserve(capacity);
+}
+
+void ParticleSystem::shrink(float dt)
+{
+	// One step per update: the storage has been halved
+	// on the previous one, now trim the vertices down to it
+	if (m_is_shrinking_vertices)
+	{
+		std::pmr::vector<sf::Vertex> vertices(m_vertices.get_allocator());
+		vertices.reserve(m_storage.getCapacity() * 6);
+
+		m_vertices.swap(vertices);
+		m_cached_vertices = 0;
+		m_is_vertices_dirty = true;
+		m_is_shrinking_vertices = false;
+
+		return;
+	}
+
+	if (m_shrink_delay <= 0.0f)
+		return;
+
+	std::size_t capacity = m_storage.getCapacity();
+	std::size_t limit = static_cast<std::size_t>(capacity * m_shrink_usage);
+
+	if (capacity <= ParticleStorage::alignment || m_storage.getSize() >= limit)
+	{
+		m_shrink_timer = 0.0f;
+		return;
+	}
+
+	m_shrink_timer += dt;
+
+	if (m_shrink_timer < m_shrink_delay)
+		return;
+
+	m_storage.shrink(capacity / 2);
+
+	// Nothing to trim, if the particles haven't let the storage shrink
+	if (m_storage.getCapacity() < capacity)
+		m_is_shrinking_vertices = true;
+	else
+		m_shrink_timer = 0.0f;
+}
+
+void ParticleSystem::updateHighWaterMarks()
+{
+#if PARTICLE_SYSTEM_INSTRUMENTATION
+	m_high_water_mark = std::max(m_high_water_mark, m_storage.getSize());
+
+	MemoryUsage usage = getMemoryUsage();
+
+	m_peak_memory.particles = std::max(m_peak_memory.particles, usage.particles);
+	m_peak_memory.vertices = std::max(m_peak_memory.vertices, usage.vertices);
+	m_peak_memory.palette = std::max(m_peak_memory.palette, usage.palette);
+#endif
+}
+
+void ParticleSystem::updateVertices() const
+{
+	PARTICLE_PROFILE_SCOPE("vertices");
+
+	PARTICLE_COST_SCOPE(m_cost.vertices_time);
+
+	std::size_t count = m_storage.getSize();
+
+	m_vertices.resize(count * 6);
+
+	// The quads of the sleepers are still in place, unless
+	// the alpha of the particles follows their lifetime
+	std::size_t first = m_is_attenuated ? 0 : std::min(m_cached_vertices, count);
+
+	sf::Vector2f texture_size = m_texture ? sf::Vector2f(m_texture->getSize()) : sf::Vector2f();
+	float inv_lifetime = (m_lifetime_max > 0.0f) ? 1.0f / m_lifetime_max : 0.0f;
+
+	for (std::size_t i = first; i < count; ++i)
+	{
+		float angle = m_storage.rotation[i] * deg_to_rad;
+		float sine, cosine;
+		sinCos(angle, sine, cosine);
+
+		float half_width = m_storage.size_x[i] * 0.5f;
+		float half_height = m_storage.size_y[i] * 0.5f;
+
+		sf::Vector2f center(m_storage.position_x[i], m_storage.position_y[i]);
+		sf::Vector2f right(cosine * half_width, sine * half_width);
+		sf::Vector2f down(-sine * half_height, cosine * half_height);
+
+		sf::Color color = getTint(m_storage.color_index[i]);
+
+		if (m_is_attenuated && inv_lifetime > 0.0f)
+		{
+			float ratio = std::min(m_storage.lifetime[i] * inv_lifetime, 1.0f);
+			color.a = static_cast<std::uint8_t>(ratio * color.a);
+		}
+
+		sf::Vertex* quad = &m_vertices[i * 6];
+
+		quad[0] = sf::Vertex{center - right - down, color, sf::Vector2f(0.0f, 0.0f)};
+		quad[1] = sf::Vertex{center + right - down, color, sf::Vector2f(texture_size.x, 0.0f)};
+		quad[2] = sf::Vertex{center + right + down, color, texture_size};
+		quad[3] = quad[0];
+		quad[4] = quad[2];
+		quad[5] = sf::Vertex{center - right + down, color, sf::Vector2f(0.0f, texture_size.y)};
+	}
+
+	m_cached_vertices = m_sleeping;
+	m_is_vertices_dirty = false;
+}
+
+sf::Color ParticleSystem::getTint(std::uint8_t color_index) const
+{
+	if (color_index >= m_palette.size())
+		return m_color;
+
+	return m_color * m_palette[color_index];
+}
+
+void ParticleSystem::sinCos(float angle, float& sine, float& cosine) const
+{
+	if (m_is_fast_math)
+	{
+		fastSinCos(angle, sine, cosine);
+		return;
+	}
+
+	sine = std::sin(angle);
+	cosine = std::cos(angle);
 }
@@ -1,13 +1,82 @@
+#pragma once
+
 #include <SFML/Graphics.hpp>
 
-#include <list>
-#include <memory>
+#include "ParticleConfig.hpp"
+#include "ParticleExpression.hpp"
+#include "ParticleHistogram.hpp"
+#include "ParticleNode.hpp"
+#include "ParticleRandom.hpp"
+#include "ParticleStorage.hpp"
+
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+class ParticleWorld;
 
 class ParticleSystem :
 	public sf::Drawable
 {
 public:
-	ParticleSystem();
+	// Construct the particle system
+	//
+	// All the memory of the system (the particles, the vertices
+	// and the palette) is allocated from the given resource,
+	// which must outlive the system. Thus the systems created
+	// within a per-level arena can be freed by a single release
+	// of that arena, once the systems are destroyed.
+	// The system can be moved (and kept by value in a container),
+	// but not while it is in a ParticleWorld, which keeps its address.
+	//
+	// parameter: memory resource, the default one if omitted
+	explicit ParticleSystem(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+	// Accumulated cost of the system, since the creation
+	// or the last resetCost
+	//
+	// The update time includes the times of its phases (spawn,
+	// integrate, behavior and compaction), the vertices are
+	// generated by the draw or by getVertices, whichever comes first.
+	struct Cost
+	{
+		std::int64_t update_time      = 0;   // in nanoseconds
+		std::int64_t draw_time        = 0;   // in nanoseconds
+		double       particle_seconds = 0.0; // particles alive * simulated time
+
+		std::int64_t spawn_time       = 0;   // in nanoseconds
+		std::int64_t integrate_time   = 0;   // in nanoseconds
+		std::int64_t behavior_time    = 0;   // in nanoseconds
+		std::int64_t compaction_time  = 0;   // in nanoseconds
+		std::int64_t vertices_time    = 0;   // in nanoseconds
+	};
+
+	// Memory, held by the system, in bytes
+	struct MemoryUsage
+	{
+		std::size_t particles = 0;
+		std::size_t vertices  = 0;
+		std::size_t palette   = 0;
+
+		std::size_t getTotal() const;
+	};
+
+	// Integration scheme of the particles motion
+	//
+	// SemiImplicitEuler - the velocity is updated first (the drag is
+	//                     applied exactly, as the factor e^(-drag * dt)),
+	//                     then moves the particle, first order accurate
+	// Exact             - the closed form solution for the constant
+	//                     acceleration and the linear drag, so the
+	//                     trajectory doesn't depend on the time step
+	enum class Integrator
+	{
+		SemiImplicitEuler,
+		Exact
+	};
 
 	// Change the source texture of the sprite instanse inside the system
 	//
@@ -34,15 +103,43 @@ public:
 	// (which means recolor all the particles)
 	void setColor(const sf::Color& color);
 
+	// Set the palette of the particle tints
+	//
+	// Each respawned particle picks a random entry of the palette
+	// and keeps only its index (one byte), so the palette may hold
+	// up to 256 colors, extra entries are ignored.
+	// The tint is modulated (multiplied) with the global color,
+	// set by setColor, and with the opacity, if attenuation is enabled.
+	// By default the palette is empty, so all the particles
+	// have the global color.
+	//
+	// parameter: new palette
+	//
+	// See getPalette, setColor
+	void setPalette(const std::vector<sf::Color>& palette);
+
 	// Set the size of the rectangle
 	//
 	// parameter: new size of the particles in pixels
 	void setParticleSize(const sf::Vector2f& size);
 
+	// Set the range of the initial size of the particles
+	//
+	// This function completely overwrites the previous range,
+	// setParticleSize resets it to a single value.
+	// Each respawned particle gets a size between min and max,
+	// the aspect ratio is interpolated between the bounds
+	// 
+	// parameters: minimal and maximal size in pixels
+	// 
+	// See getParticleSizeRange
+	void setParticleSizeRange(const sf::Vector2f& min, const sf::Vector2f& max);
+
 	// Set the point of emission
 	// 
 	// Its function completely overwrites the previous point.
 	// The default position of emission is (0, 0).
+	// While the system is attached, the point is in the node space.
 	// 
 	// parameter: new point
 	// 
@@ -53,12 +150,34 @@ public:
 	// 
 	// This function completely overwrites the previous direction.
 	// The default direction of emission is 0.
+	// While the system is attached, the direction is in the node space.
 	// 
 	// parameter: new direction, as sf::Angle
 	// 
 	// See sf::Angle, getDirection
 	void setDirection(sf::Angle direction);
 
+	// Attach the emitter to the node of a transform hierarchy
+	// 
+	// The point and the direction of emission (setEmitter, setDirection)
+	// become relative to the node, and follow it without the calls
+	// of the setters every frame: the system compares the version
+	// of the node on each update and recomputes the world emitter
+	// only when the node or its ancestors have changed.
+	// ParticleWorld resolves the attachments of all its systems in one
+	// pass before their updates. The node must outlive the attachment.
+	// On attaching, the current point and direction become the offsets
+	// in the node space; on detaching, the emitter stays where it was.
+	// The deterministic system resolves the node in the fixed-point
+	// (see ParticleNode::transformPointFixed), so the attached systems
+	// stay lockstep-safe too.
+	// By default the system isn't attached
+	// 
+	// parameter: node, nullptr to detach
+	// 
+	// See ParticleNode, getNode, getEmitter
+	void attach(const ParticleNode* node);
+
 	// Set the dispersion level of emission
 	// 
 	// This function completely overwrites the previous value.
@@ -90,6 +209,27 @@ public:
 	// See getVelocity
 	void setVelocity(float velocity);
 
+	// Set the range of the velocity of the particles
+	// 
+	// This function completely overwrites the previous range,
+	// setVelocity resets it to a single value.
+	// 
+	// parameters: minimal and maximal velocity, in pixels per sec
+	// 
+	// See getVelocityRange
+	void setVelocityRange(float min, float max);
+
+	// Set the range of the angular velocity of the particles
+	// 
+	// This function completely overwrites the previous range.
+	// The default angular velocity is 0, so the particles keep
+	// their initial (random) rotation.
+	// 
+	// parameters: minimal and maximal angular velocity, per sec
+	// 
+	// See sf::Angle, getAngularVelocityRange
+	void setAngularVelocityRange(sf::Angle min, sf::Angle max);
+
 	// Set the rate of the particles respawn
 	// 
 	// This function completely overwrites the previous value.
@@ -128,6 +268,18 @@ public:
 	// See getLifeTime
 	void setLifeTime(float lifetime);
 
+	// Set the range of the particles lifetime
+	// 
+	// This function completely overwrites the previous range,
+	// setLifeTime is equivalent to setLifeTimeRange(0, lifetime).
+	// As well as setLifeTime, the range is added to a second
+	// as minimum, i.e. particles live 1 + (min ... max) seconds
+	// 
+	// parameters: minimal and maximal lifetime
+	// 
+	// See getLifeTimeRange
+	void setLifeTimeRange(float min, float max);
+
 	// Set the exponential scaling of the particles
 	// 
 	// This function completely overwrites the previous value.
@@ -140,10 +292,89 @@ public:
 	// See getExponentialGrowth
 	void setExponentialGrowth(const sf::Vector2f& factors);
 
+	// Set the constant acceleration of the particles (gravity, wind)
+	// 
+	// This function completely overwrites the previous value.
+	// The default acceleration is (0, 0)
+	// 
+	// parameter: new acceleration, in pixels per sec^2
+	// 
+	// See getAcceleration
+	void setAcceleration(const sf::Vector2f& acceleration);
+
+	// Set the linear drag of the particles
+	// 
+	// The velocity decays as e^(-drag * t), so the drag of 1
+	// leaves ~37% of the velocity after a second. With the
+	// acceleration the particles tend to acceleration / drag.
+	// The default drag is 0
+	// 
+	// parameter: new drag, per sec
+	// 
+	// See getDrag
+	void setDrag(float drag);
+
+	// Set the integration scheme of the particles motion
+	// 
+	// The default is Integrator::SemiImplicitEuler
+	// 
+	// See Integrator, getIntegrator
+	void setIntegrator(Integrator integrator);
+
+	// Let the particles, that almost stopped, fall asleep
+	// 
+	// A particle, which speed stays below 'speed' for 'frames'
+	// updates in a row, moves to the sleeping partition: only its
+	// lifetime runs and it is drawn from the cached vertices.
+	// The sleepers wake up on setAcceleration, setDrag and wakeUp.
+	// The particles never sleep, while they grow or rotate, and
+	// the attenuated ones still regenerate their vertices.
+	// By default are disable (frames is 0)
+	// 
+	// parameters: speed in pixels per sec, frames up to 255
+	// 
+	// See wakeUp, getSleepingCount
+	void setSleeping(float speed, std::size_t frames = 30);
+
+	// Set the custom behavior of the particles
+	// 
+	// The expression runs over the awake particles on every update,
+	// after the integration, so it can change their motion, size,
+	// rotation and lifetime without the new code in the system.
+	// The expression must exist as long as the system uses it,
+	// one expression can be shared by many systems.
+	// Isn't applied in the deterministic mode.
+	// 
+	// parameter: compiled expression, nullptr to remove the behavior
+	// 
+	// See ParticleExpression, getBehavior
+	void setBehavior(const ParticleExpression* expression);
+
+	// Set the time scale of the system (slow motion, pause)
+	// 
+	// The time step of update is multiplied by the scale, so the
+	// emission, the motion and the lifetime slow down together and
+	// the particles are spawned at the same points of the scaled time.
+	// The scale of 0 pauses the system: update returns at once, and
+	// the draw reuses the vertices of the last update.
+	// The scale is multiplied by the one of ParticleWorld.
+	// The default scale is 1
+	// 
+	// parameter: new scale, the negative ones are clamped to 0
+	// 
+	// See getTimeScale, ParticleWorld::setTimeScale
+	void setTimeScale(float scale);
+
+	// Wake up all the sleeping particles
+	// 
+	// Call it, when something, that isn't known to the system,
+	// is going to move them (e.g. the colliders have changed)
+	void wakeUp();
+
 	// This function enables or disables particle generation.
 	// 
 	// By default are disable, and always turn off when
-	// explosion mode is active
+	// explosion mode is active. Enabling wakes up the idle system
 	// 
 	// See getEmitted
 	void setEmitted(bool emitted);
@@ -155,6 +386,38 @@ public:
 	// See getAttenuated
 	void setAttenuated(bool attenuation);
 
+	// Switch between the libm and the polynomial trigonometry
+	//
+	// The fast mode uses the approximations of FastMath.hpp
+	// (absolute error below 1.5e-7) for the directions of the
+	// respawned particles and the rotation of the vertices,
+	// which is several times cheaper than std::sin, std::cos.
+	// By default are disable
+	//
+	// See isFastMath
+	void setFastMath(bool fast);
+
+	// Simulate the particles bit-identically on every machine
+	//
+	// The position, the velocity and the lifetime are kept as the
+	// Q16.16 numbers (see FixedPoint.hpp) and the respawn uses the
+	// integer random values and the table trigonometry, so the
+	// systems of the lockstep peers stay the same, as long as they
+	// get the same seed, setters and time steps. The floats are only
+	// derived from them for the rendering; the size, the rotation
+	// and the color stay float, as they don't affect the gameplay.
+	// The positions are limited to [-32768, 32768) pixels (they wrap
+	// around), the velocity saturates at 32768 pixels/s, the drag
+	// is linear (the damping is 1 - drag * dt) and the integrator
+	// is always the semi-implicit Euler. The attachment (see attach)
+	// is resolved in the fixed-point as well.
+	// Enable it before the first update, the existing particles
+	// are only rounded to the fixed-point.
+	// By default are disable
+	//
+	// See isDeterministic
+	void setDeterministic(bool deterministic);
+
 	// Starts special mode: generates a certain amount
 	// of particles within a user-defined radius.
 	// New particles will not be generated until a 
@@ -163,59 +426,276 @@ public:
 	// parameters: amount of the particles, user-defined spread radius
 	void setExplosion(std::size_t splash_amount, float radius);
 
+	// Restart the random sequence of the system
+	//
+	// Every system owns its random generator, so the same
+	// seed and the same sequence of calls always produce
+	// the same particles, which makes the benchmarks and
+	// the replays reproducible.
+	// By default each new system gets a distinct seed
+	//
+	// parameter: new seed
+	//
+	// See getSeed
+	void setSeed(std::uint32_t seed);
+
+	// Set the name of the effect, that the system belongs to
+	//
+	// The costs of the systems with the same tag are summed
+	// up by ParticleWorld::getCostByTag.
+	// By default the tag is empty
+	//
+	// parameter: new tag
+	//
+	// See getTag, getCost
+	void setTag(std::string_view tag);
+
+	// Reset the accumulated cost of the system
+	//
+	// See getCost
+	void resetCost();
+
+	// Allow backing the particle storage with transparent huge pages
+	//
+	// Worth enabling for the pools of hundreds of thousands of
+	// particles, where the TLB misses become noticeable.
+	// Takes effect on the next growth of the storage, works
+	// on Linux only.
+	// By default are disable
+	//
+	// See isHugePagesEnabled
+	void setHugePages(bool enabled);
+
+	// Preallocate the storage for a certain amount of particles
+	//
+	// The storage grows on demand anyway, but reserving it
+	// ahead avoids the reallocations in the middle of the game.
+	// The storage shrinks only by the policy of setShrinkPolicy,
+	// so once it has reached its size (either by this function
+	// or by a warm-up), update, draw, and setExplosion no longer allocate,
+	// tools/CheckAllocations.cpp verifies it.
+	//
+	// parameter: amount of the particles
+	void reserve(std::size_t amount);
+
+	// Set the policy of releasing the unused memory
+	//
+	// Once the particles occupy less than 'usage' of the storage
+	// for 'delay' seconds in a row, the system starts to shrink:
+	// each update halves the storage or trims the vertices,
+	// but never both, so the cost is spread over the frames.
+	// The shrinking stops as soon as the usage is above the limit.
+	// The usage is clamped to [0, 0.5), so the particles fit into
+	// the halved storage; keep it well below the half, if the amount
+	// of the particles varies, or the storage may grow back.
+	// By default are disable (the delay is 0)
+	//
+	// Usage example:
+	// code:
+	//
+	// system.setShrinkPolicy(5.0f, 0.25f);
+	//
+	// end code.
+	//
+	// Now the storage is shrunk after 5 seconds below 25% usage
+	//
+	// parameters: delay in seconds, usage ratio in [0, 0.5)
+	void setShrinkPolicy(float delay, float usage = 0.25f);
+
+	// Enable or disable the histograms of the system
+	//
+	// Collects the distributions of the particles lifetime,
+	// the population (sampled once per update) and the amount
+	// of the particles spawned per update, to set the limits
+	// and the budgets from the data instead of guessing.
+	// The lifetime is the age of the particle at its death, so it
+	// includes the changes of the behavior; the storage keeps the
+	// birth times for it (4 bytes per particle), and the particles,
+	// that were alive at the enabling, aren't counted.
+	// Enabling clears the histograms and sets their ranges,
+	// the values out of the ranges fall into the edge buckets.
+	// Needs PARTICLE_SYSTEM_INSTRUMENTATION.
+	// By default are disable
+	//
+	// parameters: enable flag, upper bounds of the lifetime (in seconds),
+	// the population and the spawns per update
+	//
+	// See ParticleHistogram, getLifetimeHistogram
+	void setHistograms(bool enabled, float max_lifetime = 10.0f, float max_population = 65536.0f, float max_spawns = 256.0f);
+
+	// Advance the particles by the time step
+	//
+	// The system without the particles, the emission and the pending
+	// shrinking is idle: its update is a single branch, until
+	// setEmitted(true), setExplosion, setShrinkPolicy or reserve
+	// wakes it up. The idle system isn't sampled by the histograms.
+	// A new system is idle. The paused system is skipped
+	// the same way, see setTimeScale.
+	//
+	// See isIdle
 	void update(float dt);
 
 	const sf::Texture*  getTexture()           const;
 	const sf::Color&    getColor()             const;
+	const std::pmr::vector<sf::Color>& getPalette() const;
 	const sf::Vector2f& getParticleSize()      const;
+	std::pair<sf::Vector2f, sf::Vector2f> getParticleSizeRange() const;
+	const ParticleNode* getNode()              const;
+
+	// Get the point and the direction of emission in the world space,
+	// as of the last update, if the system is attached
 	const sf::Vector2f& getEmitter()           const;
 	sf::Angle           getDirection()         const;
 	sf::Angle           getDispersion()        const;
 	float               getVelocity()          const;
+	std::pair<float, float>         getVelocityRange()        const;
+	std::pair<sf::Angle, sf::Angle> getAngularVelocityRange() const;
 	float               getRespawnRate()       const;
 	const sf::Vector2f& getRespawnArea()       const;
 	float               getLifeTime()          const;
+	std::pair<float, float> getLifeTimeRange() const;
 	const sf::Vector2f& getExponentialGrowth() const;
+	const sf::Vector2f& getAcceleration()      const;
+	float               getDrag()              const;
+	Integrator          getIntegrator()        const;
+	const ParticleExpression* getBehavior()    const;
+	float               getTimeScale()         const;
+
+	std::size_t         getParticleCount() const;
+	std::size_t         getSleepingCount() const;
+
+	// Get the vertices of the particles, exactly as they are drawn
+	//
+	// Six vertices (two triangles) per particle, in the order of
+	// the storage. Allows to render the system in a custom way,
+	// or to compare the visual output (positions, colors, sizes)
+	// of two systems, regardless of their internals.
+	const std::pmr::vector<sf::Vertex>& getVertices() const;
+
+	std::uint32_t       getSeed()          const;
+	const std::pmr::string& getTag()       const;
+
+	// Cost of the system, each update and each draw
+	// measure themselves with a pair of timestamps.
+	// Stays zero, if PARTICLE_SYSTEM_INSTRUMENTATION is 0
+	const Cost&         getCost()          const;
 
 	bool                isEmitted()    const;
 	bool                isAttenuated() const;
+	bool                isFastMath()   const;
+	bool                isDeterministic() const;
+	bool                isIdle()       const;
+	bool                isHugePagesEnabled() const;
+
+	MemoryUsage         getMemoryUsage()     const;
+	MemoryUsage         getPeakMemoryUsage() const;
+
+	// Maximal amount of the particles, that were alive at once
+	//
+	// The high-water marks stay zero,
+	// if PARTICLE_SYSTEM_INSTRUMENTATION is 0
+	std::size_t         getHighWaterMark()   const;
+
+	const ParticleHistogram& getLifetimeHistogram()   const;
+	const ParticleHistogram& getPopulationHistogram() const;
+	const ParticleHistogram& getSpawnHistogram()      const;
+	bool                     isHistogramsEnabled()    const;
+
+	std::pmr::memory_resource* getMemoryResource() const;
 
 private:
+	friend class ParticleWorld;
+
 	void draw(sf::RenderTarget& target, const sf::RenderStates& states) const override;
-	void createParticle();
-	void setSize(sf::Sprite& sprite, const sf::Vector2f& size);
+	void wake();
+	bool isActive() const;
+	void resolveAttachment();
+	void emitParticles(float dt);
+	void integrate(float dt);
+	void move(float dt, std::size_t first, std::size_t count);
+	void moveFixed(float dt, std::size_t first, std::size_t count);
+	void fallAsleep();
+	void runBehavior(float dt);
+	void compact();
+	void createParticles(std::size_t count);
+	void spawnFixed(std::size_t first, std::size_t count);
+	void explodeFixed(std::size_t first, std::size_t count, float radius);
+	void syncFixed(std::size_t first, std::size_t count);
+	void initParticles(std::size_t first, std::size_t count);
+	void reserveVertices();
+	void shrink(float dt);
+	void updateHighWaterMarks();
+	void updateVertices() const;
+	sf::Color getTint(std::uint8_t color_index) const;
+	void sinCos(float angle, float& sine, float& cosine) const;
 	
 private:
-	struct ParticleController
-	{
-		sf::Vector2f velocity;
-		float        lifetime = 0.0f;
-	};
+	ParticleStorage                       m_storage;
+	std::pmr::vector<sf::Color>           m_palette;
+	mutable std::pmr::vector<sf::Vertex>  m_vertices;
+	std::pmr::string                      m_tag;
+	mutable Cost                          m_cost;
+	MemoryUsage                           m_peak_memory;
+	std::size_t                           m_high_water_mark;
+	std::size_t                           m_sleeping; // the sleepers are [0, m_sleeping)
+	mutable std::size_t                   m_cached_vertices;
+	const ParticleExpression*             m_behavior;
+	std::pmr::vector<float>               m_behavior_scratch;
+	ParticleWorld*                        m_world; // to be woken up, see ParticleWorld::addSystem
+	const ParticleNode*                   m_node;
+	std::uint32_t                         m_node_version; // that m_emitter was resolved for
 
-	struct Particle
-	{
-		ParticleController controller;
-		sf::Sprite         sprite;
-	};
+	ParticleHistogram m_lifetime_histogram;
+	ParticleHistogram m_population_histogram;
+	ParticleHistogram m_spawn_histogram;
+	std::size_t       m_spawned;
+	double            m_histogram_time; // of the birth times
 
-	std::list<std::unique_ptr<Particle>> m_particles;
+	const sf::Texture* m_texture;
+	sf::Color          m_color;
+	std::uint32_t      m_seed;
+	ParticleRandom     m_random;
 
 	sf::Vector2f m_emitter;
+	sf::Vector2f m_local_emitter; // of the attached system
 	sf::Vector2f m_respawn_area;
 	sf::Vector2f m_particle_size;
+	sf::Vector2f m_particle_size_max;
 	sf::Vector2f m_exponential_growth;
+	sf::Vector2f m_acceleration;
 
 	sf::Angle m_direction;
+	sf::Angle m_local_direction;
 	sf::Angle m_dispersion;
+	sf::Angle m_angular_velocity_min;
+	sf::Angle m_angular_velocity_max;
 
 	float m_velocity;
+	float m_velocity_max;
+	float m_lifetime_min;
 	float m_lifetime_max;
+	float m_drag;
+	float m_sleep_speed;
 	float m_rate;
+	float m_time_scale;
 	float m_timer;
+	std::int64_t m_fixed_timer; // Q16.16
+	float m_shrink_delay;
+	float m_shrink_usage;
+	float m_shrink_timer;
 	
 
+	Integrator   m_integrator;
+	std::uint8_t m_sleep_frames;
+
 	bool m_is_emitted;
 	bool m_is_attenuated;
+	bool m_is_fast_math;
+	bool m_is_deterministic;
+	bool m_is_shrinking_vertices;
+	bool m_is_histograms_enabled;
+	bool m_is_idle;
+	bool m_is_skipped; // idle or paused
 
-	sf::Sprite m_instance;
+	mutable bool m_is_vertices_dirty;
 };
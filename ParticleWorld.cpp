@@ -0,0 +1,221 @@
+#include "ParticleWorld.hpp"
+
+#include <algorithm>
+
+namespace
+{
+	std::int64_t getTime(const ParticleSystem::Cost& cost)
+	{
+		return cost.update_time + cost.draw_time;
+	}
+
+	ParticleSystem::Cost subtract(const ParticleSystem::Cost& a, const ParticleSystem::Cost& b)
+	{
+		ParticleSystem::Cost cost;
+
+		cost.update_time = a.update_time - b.update_time;
+		cost.draw_time = a.draw_time - b.draw_time;
+		cost.particle_seconds = a.particle_seconds - b.particle_seconds;
+		cost.spawn_time = a.spawn_time - b.spawn_time;
+		cost.integrate_time = a.integrate_time - b.integrate_time;
+		cost.behavior_time = a.behavior_time - b.behavior_time;
+		cost.compaction_time = a.compaction_time - b.compaction_time;
+		cost.vertices_time = a.vertices_time - b.vertices_time;
+
+		return cost;
+	}
+}
+
+ParticleWorld::ParticleWorld(std::pmr::memory_resource* resource) :
+	m_systems(resource),
+	m_active(resource),
+	m_window_start(resource),
+	m_report(resource),
+	m_cost_window(1.0f),
+	m_cost_timer(0.0f),
+	m_time_scale(1.0f)
+{
+}
+
+void ParticleWorld::addSystem(ParticleSystem* system)
+{
+	system->m_world = this;
+
+	m_systems.push_back(system);
+	m_window_start.push_back(system->getCost());
+
+	if (!system->isIdle())
+		m_active.push_back(m_systems.size() - 1);
+}
+
+void ParticleWorld::removeSystem(ParticleSystem* system)
+{
+	auto found = std::find(m_systems.begin(), m_systems.end(), system);
+
+	if (found == m_systems.end())
+		return;
+
+	std::size_t index = found - m_systems.begin();
+
+	system->m_world = nullptr;
+
+	m_systems.erase(found);
+	m_window_start.erase(m_window_start.begin() + index);
+
+	auto active = std::remove(m_active.begin(), m_active.end(), index);
+	m_active.erase(active, m_active.end());
+
+	for (auto& i : m_active)
+		if (i > index)
+			--i;
+
+	auto reported = std::remove_if(m_report.begin(), m_report.end(), [system](const SystemCost& entry)
+	{
+		return entry.system == system;
+	});
+
+	m_report.erase(reported, m_report.end());
+}
+
+void ParticleWorld::setCostWindow(float seconds)
+{
+	m_cost_window = seconds;
+}
+
+void ParticleWorld::setTimeScale(float scale)
+{
+	m_time_scale = std::max(scale, 0.0f);
+}
+
+void ParticleWorld::update(float dt)
+{
+	if (m_time_scale == 0.0f)
+		return;
+
+	dt *= m_time_scale;
+
+	// The attachments are resolved in one pass, the systems
+	// of the same node find it already resolved
+	for (auto i : m_active)
+		m_systems[i]->resolveAttachment();
+
+	std::size_t active = 0;
+
+	// The systems, that have become idle, leave the list
+	for (std::size_t i = 0; i < m_active.size(); ++i)
+	{
+		ParticleSystem* system = m_systems[m_active[i]];
+
+		system->update(dt);
+
+		if (!system->isIdle())
+			m_active[active++] = m_active[i];
+	}
+
+	m_active.resize(active);
+
+	m_cost_timer += dt;
+
+	if (m_cost_timer >= m_cost_window)
+	{
+		m_cost_timer = 0.0f;
+		closeCostWindow();
+	}
+}
+
+std::vector<ParticleWorld::SystemCost> ParticleWorld::getMostExpensive(std::size_t amount) const
+{
+	amount = std::min(amount, m_report.size());
+
+	return std::vector<SystemCost>(m_report.begin(), m_report.begin() + amount);
+}
+
+std::vector<ParticleWorld::TagCost> ParticleWorld::getCostByTag() const
+{
+	std::vector<TagCost> tags;
+
+	for (const auto& entry : m_report)
+	{
+		std::string_view tag = entry.system->getTag();
+
+		auto found = std::find_if(tags.begin(), tags.end(), [tag](const TagCost& tag_cost)
+		{
+			return tag_cost.tag == tag;
+		});
+
+		if (found == tags.end())
+		{
+			tags.push_back({ tag, entry.cost, 1 });
+			continue;
+		}
+
+		found->cost.update_time += entry.cost.update_time;
+		found->cost.draw_time += entry.cost.draw_time;
+		found->cost.particle_seconds += entry.cost.particle_seconds;
+		found->cost.spawn_time += entry.cost.spawn_time;
+		found->cost.integrate_time += entry.cost.integrate_time;
+		found->cost.behavior_time += entry.cost.behavior_time;
+		found->cost.compaction_time += entry.cost.compaction_time;
+		found->cost.vertices_time += entry.cost.vertices_time;
+		found->systems++;
+	}
+
+	std::sort(tags.begin(), tags.end(), [](const TagCost& a, const TagCost& b)
+	{
+		return getTime(a.cost) > getTime(b.cost);
+	});
+
+	return tags;
+}
+
+std::size_t ParticleWorld::getSystemCount() const
+{
+	return m_systems.size();
+}
+
+std::size_t ParticleWorld::getActiveSystemCount() const
+{
+	return m_active.size();
+}
+
+float ParticleWorld::getCostWindow() const
+{
+	return m_cost_window;
+}
+
+float ParticleWorld::getTimeScale() const
+{
+	return m_time_scale;
+}
+
+void ParticleWorld::draw(sf::RenderTarget& target, const sf::RenderStates& states) const
+{
+	for (auto i : m_active)
+		target.draw(*m_systems[i], states);
+}
+
+void ParticleWorld::activate(ParticleSystem* system)
+{
+	// Waking up is rare, so the search is fine here
+	std::size_t index = std::find(m_systems.begin(), m_systems.end(), system) - m_systems.begin();
+
+	m_active.insert(std::lower_bound(m_active.begin(), m_active.end(), index), index);
+}
+
+void ParticleWorld::closeCostWindow()
+{
+	m_report.clear();
+
+	for (std::size_t i = 0; i < m_systems.size(); ++i)
+	{
+		const ParticleSystem::Cost& cost = m_systems[i]->getCost();
+
+		m_report.push_back({ m_systems[i], subtract(cost, m_window_start[i]) });
+		m_window_start[i] = cost;
+	}
+
+	std::sort(m_report.begin(), m_report.end(), [](const SystemCost& a, const SystemCost& b)
+	{
+		return getTime(a.cost) > getTime(b.cost);
+	});
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "ParticleSystem.hpp"
+
+#include <cstddef>
+#include <memory_resource>
+#include <string_view>
+#include <vector>
+
+// Group of the particle systems, updated and drawn together
+//
+// The world doesn't own the systems, they must outlive it
+// (or be removed from it before the destruction).
+// A system belongs to one world at most.
+//
+// The idle systems (see ParticleSystem::update) are kept out
+// of the active list, so the update and the draw don't even
+// iterate them; a system puts itself back, when it wakes up.
+// The active systems are updated and drawn in the order,
+// they were added in.
+// Before the updates, the world resolves the attachments
+// (see ParticleSystem::attach) of all the active systems.
+//
+// Besides that, the world keeps the cost report of its systems:
+// every 'window' seconds of the simulated time it takes the cost,
+// that each system has accumulated during the window, so the most
+// expensive systems and effects can be found at runtime.
+class ParticleWorld :
+	public sf::Drawable
+{
+public:
+	struct SystemCost
+	{
+		const ParticleSystem* system = nullptr;
+		ParticleSystem::Cost  cost;
+	};
+
+	struct TagCost
+	{
+		std::string_view     tag;
+		ParticleSystem::Cost cost;
+		std::size_t          systems = 0;
+	};
+
+	explicit ParticleWorld(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+	void addSystem(ParticleSystem* system);
+	void removeSystem(ParticleSystem* system);
+
+	// Set the length of the cost report window
+	//
+	// The default window is a second
+	//
+	// parameter: new window, in seconds of the simulated time
+	void setCostWindow(float seconds);
+
+	// Set the time scale of all the systems (slow motion, pause)
+	//
+	// Multiplies the own scale of each system, the scale of 0
+	// pauses the whole world: update returns at once and the
+	// systems are drawn as they were. The cost window runs
+	// in the scaled time as well.
+	// The default scale is 1
+	//
+	// parameter: new scale, the negative ones are clamped to 0
+	//
+	// See ParticleSystem::setTimeScale
+	void setTimeScale(float scale);
+
+	void update(float dt);
+
+	// Get the most expensive systems of the last complete window
+	//
+	// The systems are sorted by the update + draw time
+	//
+	// parameter: maximal amount of the systems
+	std::vector<SystemCost> getMostExpensive(std::size_t amount) const;
+
+	// Get the cost of the last complete window, grouped by tags
+	//
+	// The tags are sorted by the update + draw time,
+	// the untagged systems are grouped under the empty tag
+	std::vector<TagCost> getCostByTag() const;
+
+	std::size_t getSystemCount() const;
+	std::size_t getActiveSystemCount() const;
+	float       getCostWindow()  const;
+	float       getTimeScale()   const;
+
+private:
+	friend class ParticleSystem;
+
+	void draw(sf::RenderTarget& target, const sf::RenderStates& states) const override;
+	void activate(ParticleSystem* system);
+	void closeCostWindow();
+
+	std::pmr::vector<ParticleSystem*>      m_systems;
+	std::pmr::vector<std::size_t>          m_active; // indices of m_systems, ascending
+	std::pmr::vector<ParticleSystem::Cost> m_window_start; // per system
+	std::pmr::vector<SystemCost>           m_report;
+
+	float m_cost_window;
+	float m_cost_timer;
+	float m_time_scale;
+};
@@ -0,0 +1,174 @@
+#include "PerfCounters.hpp"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstring>
+#endif
+
+namespace
+{
+#if defined(__linux__)
+	int openCounter(std::uint32_t type, std::uint64_t config)
+	{
+		perf_event_attr attr;
+		std::memset(&attr, 0, sizeof(attr));
+
+		attr.size = sizeof(attr);
+		attr.type = type;
+		attr.config = config;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+		return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+	}
+
+	constexpr std::uint64_t cacheConfig(std::uint64_t cache)
+	{
+		return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	}
+#endif
+}
+
+PerfCounters::Sample& PerfCounters::Sample::operator += (const Sample& other)
+{
+	for (int i = 0; i < CounterCount; ++i)
+	{
+		values[i] += other.values[i];
+		is_valid[i] = is_valid[i] || other.is_valid[i];
+	}
+
+	return *this;
+}
+
+void PerfCounters::Sample::print(std::ostream& stream, std::size_t particles) const
+{
+	double divisor = particles ? static_cast<double>(particles) : 1.0;
+
+	for (int i = 0; i < CounterCount; ++i)
+	{
+		stream << getName(static_cast<Counter>(i)) << '/' << "particle: ";
+
+		if (is_valid[i])
+			stream << values[i] / divisor << '\n';
+		else
+			stream << "n/a\n";
+	}
+}
+
+void PerfCounters::Sample::writeJson(std::ostream& stream, double particles) const
+{
+	static const char* const keys[CounterCount] = { "cycles", "instructions", "l1_misses", "llc_misses", "branch_misses" };
+
+	double divisor = (particles > 0.0) ? particles : 1.0;
+
+	stream << '{';
+
+	for (int i = 0; i < CounterCount; ++i)
+	{
+		stream << (i ? ",\"" : "\"") << keys[i] << "\":";
+
+		if (is_valid[i])
+			stream << values[i] / divisor;
+		else
+			stream << "null";
+	}
+
+	stream << '}';
+}
+
+PerfCounters::PerfCounters()
+{
+	for (int& descriptor : m_descriptors)
+		descriptor = -1;
+
+#if defined(__linux__)
+	m_descriptors[Cycles]       = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+	m_descriptors[Instructions] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+	m_descriptors[L1Misses]     = openCounter(PERF_TYPE_HW_CACHE, cacheConfig(PERF_COUNT_HW_CACHE_L1D));
+	m_descriptors[LLCMisses]    = openCounter(PERF_TYPE_HW_CACHE, cacheConfig(PERF_COUNT_HW_CACHE_LL));
+	m_descriptors[BranchMisses] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+#endif
+}
+
+PerfCounters::~PerfCounters()
+{
+#if defined(__linux__)
+	for (int descriptor : m_descriptors)
+		if (descriptor != -1)
+			close(descriptor);
+#endif
+}
+
+void PerfCounters::start()
+{
+#if defined(__linux__)
+	for (int descriptor : m_descriptors)
+	{
+		if (descriptor != -1)
+		{
+			ioctl(descriptor, PERF_EVENT_IOC_RESET, 0);
+			ioctl(descriptor, PERF_EVENT_IOC_ENABLE, 0);
+		}
+	}
+#endif
+}
+
+PerfCounters::Sample PerfCounters::stop()
+{
+	Sample sample;
+
+#if defined(__linux__)
+	for (int i = 0; i < CounterCount; ++i)
+	{
+		int descriptor = m_descriptors[i];
+
+		if (descriptor == -1)
+			continue;
+
+		ioctl(descriptor, PERF_EVENT_IOC_DISABLE, 0);
+
+		// value, time enabled, time running
+		std::uint64_t data[3] = {};
+
+		if (read(descriptor, data, sizeof(data)) != sizeof(data) || data[2] == 0)
+			continue;
+
+		// The kernel multiplexes the counters, when there are more of them
+		// than the hardware supports, so scale the value to the whole interval
+		double scale = static_cast<double>(data[1]) / static_cast<double>(data[2]);
+
+		sample.values[i] = static_cast<std::uint64_t>(data[0] * scale);
+		sample.is_valid[i] = true;
+	}
+#endif
+
+	return sample;
+}
+
+bool PerfCounters::isAvailable() const
+{
+	for (int descriptor : m_descriptors)
+		if (descriptor != -1)
+			return true;
+
+	return false;
+}
+
+const char* PerfCounters::getName(Counter counter)
+{
+	switch (counter)
+	{
+		case Cycles:       return "cycles";
+		case Instructions: return "instructions";
+		case L1Misses:     return "L1 misses";
+		case LLCMisses:    return "LLC misses";
+		case BranchMisses: return "branch misses";
+		default:           return "unknown";
+	}
+}
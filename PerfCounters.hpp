@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+// Hardware performance counters of the calling thread
+//
+// Wraps Linux perf_event_open, so it needs nothing but the kernel
+// (and perf_event_paranoid allowing the user space measurements).
+// Intended for the benchmarks: put start/stop around the measured
+// phase and divide the sample by the amount of the particles.
+// On the other platforms, or when the kernel refuses to open
+// a counter, that counter simply stays unavailable.
+//
+// Usage example:
+// code:
+//
+// PerfCounters counters;
+//
+// counters.start();
+// system.update(dt);
+// PerfCounters::Sample sample = counters.stop();
+//
+// sample.print(std::cout, system.getParticleCount());
+//
+// end code.
+//
+// The benchmarks of tools/ take the counters with --counters
+// and write them per particle, see measure and writeJson.
+class PerfCounters
+{
+public:
+	enum Counter
+	{
+		Cycles,
+		Instructions,
+		L1Misses,
+		LLCMisses,
+		BranchMisses,
+		CounterCount
+	};
+
+	struct Sample
+	{
+		std::uint64_t values[CounterCount] = {};
+		bool          is_valid[CounterCount] = {};
+
+		Sample& operator += (const Sample& other);
+
+		// Print the counters divided by the amount of the particles
+		void print(std::ostream& stream, std::size_t particles) const;
+
+		// Write {"cycles":..,"instructions":..,"l1_misses":..,"llc_misses":..,
+		// "branch_misses":..} divided by the amount of the particles,
+		// the unavailable counters are null
+		void writeJson(std::ostream& stream, double particles) const;
+	};
+
+	PerfCounters();
+	~PerfCounters();
+
+	PerfCounters(const PerfCounters&) = delete;
+	PerfCounters& operator = (const PerfCounters&) = delete;
+
+	void   start();
+	Sample stop();
+
+	bool isAvailable() const;
+
+	static const char* getName(Counter counter);
+
+	// Run the function between start and stop and add the counts
+	// to the sample; without the counters (nullptr) just run it
+	template <typename Function>
+	static void measure(PerfCounters* counters, Sample& sample, Function&& function)
+	{
+		if (!counters)
+		{
+			function();
+			return;
+		}
+
+		counters->start();
+		function();
+		sample += counters->stop();
+	}
+
+private:
+	int m_descriptors[CounterCount];
+};
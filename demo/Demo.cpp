@@ -0,0 +1,366 @@
+// Stress test of the particle system
+//
+// Spawns a grid of systems and shows the frame statistics
+// in the window title: FPS, particles, update/draw time and
+// the memory, allocated by the systems.
+//
+// Usage:
+// Demo [--systems N] [--rate R] [--lifetime L] [--velocity V]
+//      [--texture path] [--seed S] [--headless --frames N]
+//
+// The headless mode runs without a window (and without a GPU):
+// it simulates N frames at 60 Hz, generates the vertices each
+// frame and prints the measurements, including the hardware
+// counters, if the kernel allows them.
+//
+// Keys: A - attenuation, P - palette, S - spin, R - size and
+// velocity ranges, E - emission, X - explosion (stops the emission,
+// each system explodes, once its particles are dead), H - huge pages,
+// F - fast math
+
+#include "../ParticleSystem.hpp"
+#include "../PerfCounters.hpp"
+#include "../tools/TrackingResource.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+	struct Options
+	{
+		std::size_t systems  = 16;
+		float       rate     = 2000.0f;
+		float       lifetime = 2.0f;
+		float       velocity = 100.0f;
+		std::string texture;
+		unsigned    seed     = 1;
+		bool        headless = false;
+		std::size_t frames   = 600;
+	};
+
+	struct Features
+	{
+		bool attenuated = true;
+		bool palette    = true;
+		bool spin       = false;
+		bool ranges     = false;
+		bool emitted    = true;
+		bool huge_pages = false;
+		bool fast_math  = false;
+	};
+
+	bool parseOptions(int argc, char* argv[], Options& options)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const char* arg = argv[i];
+			const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+
+			if (!std::strcmp(arg, "--headless"))
+			{
+				options.headless = true;
+				continue;
+			}
+
+			if (!value)
+				return false;
+
+			if (!std::strcmp(arg, "--systems"))       options.systems = std::strtoul(value, nullptr, 10);
+			else if (!std::strcmp(arg, "--rate"))     options.rate = std::strtof(value, nullptr);
+			else if (!std::strcmp(arg, "--lifetime")) options.lifetime = std::strtof(value, nullptr);
+			else if (!std::strcmp(arg, "--velocity")) options.velocity = std::strtof(value, nullptr);
+			else if (!std::strcmp(arg, "--texture"))  options.texture = value;
+			else if (!std::strcmp(arg, "--seed"))     options.seed = std::strtoul(value, nullptr, 10);
+			else if (!std::strcmp(arg, "--frames"))   options.frames = std::strtoul(value, nullptr, 10);
+			else
+				return false;
+
+			++i;
+		}
+
+		return options.systems > 0;
+	}
+
+	sf::Vector2f getParticleSize(const sf::Texture* texture)
+	{
+		return texture ? sf::Vector2f(texture->getSize()) : sf::Vector2f(4.0f, 4.0f);
+	}
+
+	void applyFeatures(ParticleSystem& system, const Options& options, const Features& features)
+	{
+		system.setEmitted(features.emitted);
+		system.setAttenuated(features.attenuated);
+		system.setHugePages(features.huge_pages);
+		system.setFastMath(features.fast_math);
+
+		if (features.palette)
+			system.setPalette({ sf::Color(255, 80, 40), sf::Color(255, 200, 60), sf::Color(255, 255, 220) });
+		else
+			system.setPalette({});
+
+		if (features.spin)
+			system.setAngularVelocityRange(sf::degrees(-180.0f), sf::degrees(180.0f));
+		else
+			system.setAngularVelocityRange(sf::degrees(0.0f), sf::degrees(0.0f));
+
+		sf::Vector2f size = getParticleSize(system.getTexture());
+
+		if (features.ranges)
+		{
+			system.setVelocityRange(options.velocity * 0.5f, options.velocity * 1.5f);
+			system.setParticleSizeRange(size * 0.5f, size * 1.5f);
+		}
+		else
+		{
+			system.setVelocity(options.velocity);
+			system.setParticleSize(size);
+		}
+	}
+
+	std::vector<std::unique_ptr<ParticleSystem>> createSystems(const Options& options, const Features& features, const sf::Texture* texture, std::pmr::memory_resource* resource, sf::Vector2f area)
+	{
+		std::vector<std::unique_ptr<ParticleSystem>> systems;
+
+		std::size_t columns = 1;
+		while (columns * columns < options.systems)
+			++columns;
+
+		std::size_t rows = (options.systems + columns - 1) / columns;
+		sf::Vector2f cell(area.x / columns, area.y / rows);
+
+		for (std::size_t i = 0; i < options.systems; ++i)
+		{
+			auto system = std::make_unique<ParticleSystem>(resource);
+
+			if (texture)
+				system->setTexture(texture);
+
+			system->setSeed(options.seed + static_cast<unsigned>(i));
+			system->setEmitter(sf::Vector2f(cell.x * (i % columns + 0.5f), cell.y * (i / columns + 0.5f)));
+			system->setDirection(sf::degrees(-90.0f));
+			system->setDispersion(sf::degrees(60.0f));
+			system->setRespawnRate(options.rate);
+			system->setLifeTime(options.lifetime);
+
+			applyFeatures(*system, options, features);
+
+			systems.push_back(std::move(system));
+		}
+
+		return systems;
+	}
+
+	std::size_t countParticles(const std::vector<std::unique_ptr<ParticleSystem>>& systems)
+	{
+		std::size_t count = 0;
+
+		for (auto& system : systems)
+			count += system->getParticleCount();
+
+		return count;
+	}
+
+	double elapsedMs(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	int runHeadless(const Options& options)
+	{
+		TrackingResource resource;
+		Features features;
+
+		{
+			auto systems = createSystems(options, features, nullptr, &resource, sf::Vector2f(1280.0f, 720.0f));
+
+			PerfCounters counters;
+			PerfCounters::Sample sample;
+
+			const float dt = 1.0f / 60.0f;
+			double update_ms = 0.0;
+			double vertices_ms = 0.0;
+			std::size_t particle_frames = 0;
+			std::size_t peak_particles = 0;
+
+			for (std::size_t frame = 0; frame < options.frames; ++frame)
+			{
+				auto start = std::chrono::steady_clock::now();
+				counters.start();
+
+				for (auto& system : systems)
+					system->update(dt);
+
+				sample += counters.stop();
+				update_ms += elapsedMs(start);
+
+				start = std::chrono::steady_clock::now();
+
+				for (auto& system : systems)
+					system->getVertices();
+
+				vertices_ms += elapsedMs(start);
+
+				std::size_t particles = countParticles(systems);
+				particle_frames += particles;
+				peak_particles = std::max(peak_particles, particles);
+			}
+
+			double frames = static_cast<double>(options.frames ? options.frames : 1);
+
+			std::cout << "frames: " << options.frames << '\n'
+				<< "systems: " << options.systems << '\n'
+				<< "average particles: " << particle_frames / frames << '\n'
+				<< "peak particles: " << peak_particles << '\n'
+				<< "update ms/frame: " << update_ms / frames << '\n'
+				<< "vertices ms/frame: " << vertices_ms / frames << '\n'
+				<< "update ns/particle: " << (particle_frames ? update_ms * 1e6 / particle_frames : 0.0) << '\n'
+				<< "memory in use: " << resource.getInUse() << '\n'
+				<< "memory peak: " << resource.getPeak() << '\n';
+
+			if (counters.isAvailable())
+				sample.print(std::cout, particle_frames);
+		}
+
+		return EXIT_SUCCESS;
+	}
+
+	int runWindowed(const Options& options)
+	{
+		sf::RenderWindow window(sf::VideoMode(sf::Vector2u(1280, 720)), "Particles");
+
+		sf::Texture texture;
+		const sf::Texture* texture_ptr = nullptr;
+
+		if (!options.texture.empty() && texture.loadFromFile(options.texture))
+			texture_ptr = &texture;
+
+		TrackingResource resource;
+		Features features;
+
+		auto systems = createSystems(options, features, texture_ptr, &resource, sf::Vector2f(1280.0f, 720.0f));
+
+		// The systems, that explode as soon as they are empty
+		std::vector<bool> explosions(systems.size(), false);
+
+		sf::Clock clock;
+		double update_ms = 0.0;
+		double draw_ms = 0.0;
+		float overlay_timer = 0.0f;
+		int frames = 0;
+
+		while (window.isOpen())
+		{
+			while (const std::optional event = window.pollEvent())
+			{
+				if (event->is<sf::Event::Closed>())
+					window.close();
+
+				const auto* key = event->getIf<sf::Event::KeyPressed>();
+
+				if (!key)
+					continue;
+
+				switch (key->code)
+				{
+					case sf::Keyboard::Key::A: features.attenuated = !features.attenuated; break;
+					case sf::Keyboard::Key::P: features.palette    = !features.palette;    break;
+					case sf::Keyboard::Key::S: features.spin       = !features.spin;       break;
+					case sf::Keyboard::Key::R: features.ranges     = !features.ranges;     break;
+					case sf::Keyboard::Key::E: features.emitted    = !features.emitted;    break;
+					case sf::Keyboard::Key::H: features.huge_pages = !features.huge_pages; break;
+					case sf::Keyboard::Key::F: features.fast_math  = !features.fast_math;  break;
+
+					// setExplosion does nothing, while the system has particles,
+					// so the emission stops and the storage drains first
+					case sf::Keyboard::Key::X:
+						features.emitted = false;
+						std::fill(explosions.begin(), explosions.end(), true);
+						break;
+
+					default:
+						continue;
+				}
+
+				for (auto& system : systems)
+					applyFeatures(*system, options, features);
+			}
+
+			float dt = clock.restart().asSeconds();
+
+			auto start = std::chrono::steady_clock::now();
+
+			for (auto& system : systems)
+				system->update(dt);
+
+			update_ms += elapsedMs(start);
+
+			for (std::size_t i = 0; i < systems.size(); ++i)
+			{
+				if (explosions[i] && systems[i]->getParticleCount() == 0)
+				{
+					systems[i]->setExplosion(static_cast<std::size_t>(options.rate), 10.0f);
+					explosions[i] = false;
+				}
+			}
+
+			window.clear();
+
+			start = std::chrono::steady_clock::now();
+
+			for (auto& system : systems)
+				window.draw(*system);
+
+			draw_ms += elapsedMs(start);
+
+			window.display();
+
+			++frames;
+			overlay_timer += dt;
+
+			if (overlay_timer >= 0.25f)
+			{
+				std::ostringstream title;
+				title.precision(3);
+
+				title << "FPS: " << frames / overlay_timer
+					<< " | particles: " << countParticles(systems)
+					<< " | update: " << update_ms / frames << " ms"
+					<< " | draw: " << draw_ms / frames << " ms"
+					<< " | memory: " << resource.getInUse() / 1024 << " KiB";
+
+				window.setTitle(title.str());
+
+				overlay_timer = 0.0f;
+				update_ms = 0.0;
+				draw_ms = 0.0;
+				frames = 0;
+			}
+		}
+
+		return EXIT_SUCCESS;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	Options options;
+
+	if (!parseOptions(argc, argv, options))
+	{
+		std::cerr << "Usage: " << argv[0] << " [--systems N] [--rate R] [--lifetime L] [--velocity V]"
+			" [--texture path] [--seed S] [--headless --frames N]\n";
+
+		return EXIT_FAILURE;
+	}
+
+	return options.headless ? runHeadless(options) : runWindowed(options);
+}
@@ -0,0 +1,272 @@
+// Check, that the particle systems don't allocate in the steady state
+//
+// Every scenario sets up the systems, reserves their storage and
+// warms them up, then runs a number of frames (update and getVertices,
+// which is all the draw does besides the call of SFML) and counts
+// the allocations of the memory resource of the systems and of the
+// global operator new. Any allocation fails the check. Prints one
+// JSON line per scenario.
+//
+// Usage:
+// CheckAllocations [--frames N]
+
+#include "../ParticleWorld.hpp"
+#include "TrackingResource.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <vector>
+
+namespace
+{
+	std::atomic<std::size_t> new_count(0);
+
+	void* allocate(std::size_t size)
+	{
+		++new_count;
+
+		if (void* pointer = std::malloc(size ? size : 1))
+			return pointer;
+
+		throw std::bad_alloc();
+	}
+
+	void* allocate(std::size_t size, std::align_val_t alignment)
+	{
+		++new_count;
+
+		auto align = static_cast<std::size_t>(alignment);
+		size = (size + align - 1) / align * align;
+
+#if defined(_MSC_VER)
+		if (void* pointer = _aligned_malloc(size ? size : align, align))
+#else
+		if (void* pointer = std::aligned_alloc(align, size ? size : align))
+#endif
+			return pointer;
+
+		throw std::bad_alloc();
+	}
+
+	void deallocateAligned(void* pointer)
+	{
+#if defined(_MSC_VER)
+		_aligned_free(pointer);
+#else
+		std::free(pointer);
+#endif
+	}
+}
+
+// The hook of the global allocations
+void* operator new(std::size_t size) { return allocate(size); }
+void* operator new[](std::size_t size) { return allocate(size); }
+void* operator new(std::size_t size, std::align_val_t alignment) { return allocate(size, alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return allocate(size, alignment); }
+void operator delete(void* pointer) noexcept { std::free(pointer); }
+void operator delete[](void* pointer) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete[](void* pointer, std::size_t) noexcept { std::free(pointer); }
+void operator delete(void* pointer, std::align_val_t) noexcept { deallocateAligned(pointer); }
+void operator delete[](void* pointer, std::align_val_t) noexcept { deallocateAligned(pointer); }
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept { deallocateAligned(pointer); }
+void operator delete[](void* pointer, std::size_t, std::align_val_t) noexcept { deallocateAligned(pointer); }
+
+namespace
+{
+	constexpr float dt = 1.0f / 60.0f;
+
+	struct Scenario
+	{
+		const char*  name;
+		std::size_t  systems;
+		std::size_t  reserve;
+
+		std::function<void(ParticleSystem&, std::size_t index)> setup;
+		std::function<void(ParticleSystem&, std::size_t frame)> step; // optional, before the update
+	};
+
+	ParticleExpression behavior;
+
+	void setupEmitter(ParticleSystem& system)
+	{
+		system.setRespawnRate(2000.0f);
+		system.setVelocityRange(20.0f, 200.0f);
+		system.setDispersion(sf::degrees(180.0f));
+		system.setLifeTimeRange(0.5f, 1.5f);
+		system.setEmitted(true);
+	}
+
+	void explodeWhenDead(ParticleSystem& system, std::size_t)
+	{
+		// The explosion restarts, once the previous one is over
+		system.setExplosion(3000, 20.0f);
+	}
+
+	bool run(const Scenario& scenario, std::size_t frames)
+	{
+		TrackingResource resource;
+		ParticleWorld world(&resource);
+		std::vector<ParticleSystem> systems;
+
+		systems.reserve(scenario.systems);
+
+		for (std::size_t i = 0; i < scenario.systems; ++i)
+		{
+			systems.emplace_back(&resource);
+			systems.back().setSeed(static_cast<std::uint32_t>(i + 1));
+
+			scenario.setup(systems.back(), i);
+			systems.back().reserve(scenario.reserve);
+		}
+
+		for (auto& system : systems)
+			world.addSystem(&system);
+
+		auto frame = [&](std::size_t index)
+		{
+			for (auto& system : systems)
+			{
+				if (scenario.step)
+					scenario.step(system, index);
+
+				system.getVertices();
+			}
+
+			world.update(dt);
+		};
+
+		// A few cost windows of the world, so its report has grown too
+		std::size_t warm_up = static_cast<std::size_t>(3.0f / dt);
+
+		for (std::size_t i = 0; i < warm_up; ++i)
+			frame(i);
+
+		std::size_t resource_count = resource.getAllocationCount();
+		std::size_t global_count = new_count;
+
+		for (std::size_t i = 0; i < frames; ++i)
+			frame(warm_up + i);
+
+		resource_count = resource.getAllocationCount() - resource_count;
+		global_count = new_count - global_count;
+
+		bool is_passed = resource_count == 0 && global_count == 0;
+
+		std::cout << "{\"scenario\":\"" << scenario.name << '"'
+			<< ",\"frames\":" << frames
+			<< ",\"resource_allocations\":" << resource_count
+			<< ",\"global_allocations\":" << global_count
+			<< ",\"passed\":" << (is_passed ? "true" : "false")
+			<< "}\n";
+
+		return is_passed;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	std::size_t frames = 600;
+
+	if (argc == 3 && !std::strcmp(argv[1], "--frames"))
+		frames = std::strtoul(argv[2], nullptr, 10);
+	else if (argc != 1)
+	{
+		std::cerr << "Usage: " << argv[0] << " [--frames N]\n";
+
+		return EXIT_FAILURE;
+	}
+
+	if (!behavior.compile("vx = vx * 0.98 + noise(x * 0.01, y * 0.01) * 50 * dt; sx = 32 * curve(life, 0, 1, 0.5); sy = sx"))
+	{
+		std::cerr << behavior.getError() << '\n';
+
+		return EXIT_FAILURE;
+	}
+
+	const Scenario scenarios[] =
+	{
+		{ "default", 1, 4096, [](ParticleSystem& system, std::size_t) { setupEmitter(system); }, nullptr },
+		{ "appearance", 1, 4096, [](ParticleSystem& system, std::size_t)
+		{
+			setupEmitter(system);
+			system.setPalette({ sf::Color::Red, sf::Color::Yellow, sf::Color::White });
+			system.setParticleSizeRange(sf::Vector2f(8.0f, 8.0f), sf::Vector2f(32.0f, 32.0f));
+			system.setAngularVelocityRange(sf::degrees(-90.0f), sf::degrees(90.0f));
+			system.setExponentialGrowth(sf::Vector2f(1.001f, 1.001f));
+			system.setAttenuated(true);
+			system.setFastMath(true);
+			system.setHistograms(true);
+		}, nullptr },
+		{ "motion", 1, 4096, [](ParticleSystem& system, std::size_t)
+		{
+			setupEmitter(system);
+			system.setAcceleration(sf::Vector2f(0.0f, 98.0f));
+			system.setDrag(0.5f);
+			system.setIntegrator(ParticleSystem::Integrator::Exact);
+		}, nullptr },
+		{ "explosion", 1, 3000, [](ParticleSystem& system, std::size_t)
+		{
+			system.setVelocityRange(50.0f, 150.0f);
+			system.setLifeTimeRange(0.0f, 0.5f);
+		}, explodeWhenDead },
+		{ "deterministic", 1, 4096, [](ParticleSystem& system, std::size_t)
+		{
+			setupEmitter(system);
+			system.setAcceleration(sf::Vector2f(0.0f, 98.0f));
+			system.setDeterministic(true);
+		}, nullptr },
+		{ "deterministic_explosion", 1, 3000, [](ParticleSystem& system, std::size_t)
+		{
+			system.setVelocityRange(50.0f, 150.0f);
+			system.setDeterministic(true);
+		}, explodeWhenDead },
+		{ "sleeping", 1, 4096, [](ParticleSystem& system, std::size_t)
+		{
+			setupEmitter(system);
+			system.setDrag(8.0f);
+			system.setSleeping(5.0f, 10);
+		}, nullptr },
+		{ "behavior", 1, 4096, [](ParticleSystem& system, std::size_t)
+		{
+			setupEmitter(system);
+			system.setBehavior(&behavior);
+		}, nullptr },
+		{ "shrink_policy", 1, 8192, [](ParticleSystem& system, std::size_t)
+		{
+			// Shrinks once within the warm-up, then stays
+			setupEmitter(system);
+			system.setShrinkPolicy(0.5f, 0.25f);
+		}, nullptr },
+		{ "shrink_policy_clamped", 1, 4096, [](ParticleSystem& system, std::size_t)
+		{
+			// 25 meant as 25%, clamped below the half
+			setupEmitter(system);
+			system.setRespawnRate(700.0f);
+			system.setShrinkPolicy(0.5f, 25.0f);
+		}, nullptr },
+		{ "world", 16, 1024, [](ParticleSystem& system, std::size_t index)
+		{
+			setupEmitter(system);
+			system.setRespawnRate(500.0f);
+			system.setTag((index & 1) ? "fire" : "smoke");
+			system.setTimeScale((index % 3) ? 1.0f : 0.5f);
+		}, [](ParticleSystem& system, std::size_t frame)
+		{
+			// The systems keep falling idle and waking up
+			if (frame % 120 == 0)
+				system.setEmitted(!system.isEmitted());
+		} }
+	};
+
+	bool is_passed = true;
+
+	for (const auto& scenario : scenarios)
+		is_passed = run(scenario, frames) && is_passed;
+
+	return is_passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,138 @@
+// Accuracy and speed check of FastMath.hpp against libm
+//
+// Sweeps every function over the ranges the particles use, measures
+// the maximal error against the double precision libm and fails, if
+// it exceeds the bound, documented in the header of FastMath.hpp.
+// Prints one JSON line per function. Build it with the same flags as
+// the game (e.g. -ffast-math or /fp:fast), the bounds must hold there too.
+//
+// Usage:
+// CheckFastMath [--samples N]
+
+#include "../FastMath.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+	struct Check
+	{
+		const char* name;
+		double      min;
+		double      max;
+		double      bound;
+		bool        is_relative;
+		bool        is_logarithmic; // the samples are spaced evenly in log(x)
+
+		float  (*fast)(float);
+		double (*reference)(double);
+	};
+
+	// Keeps the optimizer from dropping the timed loops
+	volatile float sink;
+
+	bool run(const Check& check, std::size_t samples)
+	{
+		std::vector<float> values(samples);
+
+		// Evenly spaced, including the ends of the range
+		for (std::size_t i = 0; i < samples; ++i)
+		{
+			double t = static_cast<double>(i) / (samples - 1);
+
+			if (check.is_logarithmic)
+				values[i] = static_cast<float>(check.min * std::pow(check.max / check.min, t));
+			else
+				values[i] = static_cast<float>(check.min + (check.max - check.min) * t);
+		}
+
+		double max_error = 0.0;
+		float worst = 0.0f;
+
+		for (float value : values)
+		{
+			double expected = check.reference(value);
+			double error = std::fabs(check.fast(value) - expected);
+
+			if (check.is_relative)
+				error /= std::max(std::fabs(expected), 1e-30);
+
+			if (error > max_error)
+			{
+				max_error = error;
+				worst = value;
+			}
+		}
+
+		auto time = [&](auto function)
+		{
+			// The call through the pointer is timed for both
+			float sum = 0.0f;
+			auto start = std::chrono::steady_clock::now();
+
+			for (float value : values)
+				sum += function(value);
+
+			sink = sum;
+
+			return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / samples;
+		};
+
+		double fast_ns = time(check.fast);
+		double libm_ns = time([&](float value) { return static_cast<float>(check.reference(value)); });
+
+		bool is_passed = max_error <= check.bound;
+
+		std::cout << "{\"function\":\"" << check.name << '"'
+			<< ",\"min\":" << check.min
+			<< ",\"max\":" << check.max
+			<< ",\"max_error\":" << max_error
+			<< ",\"at\":" << worst
+			<< ",\"bound\":" << check.bound
+			<< ",\"fast_ns\":" << fast_ns
+			<< ",\"libm_ns\":" << libm_ns
+			<< ",\"passed\":" << (is_passed ? "true" : "false")
+			<< "}\n";
+
+		return is_passed;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	std::size_t samples = 1 << 22;
+
+	if (argc == 3 && !std::strcmp(argv[1], "--samples"))
+		samples = std::max(2ul, std::strtoul(argv[2], nullptr, 10));
+	else if (argc != 1)
+	{
+		std::cerr << "Usage: " << argv[0] << " [--samples N]\n";
+
+		return EXIT_FAILURE;
+	}
+
+	// The bounds are the ones of the header of FastMath.hpp
+	const Check checks[] =
+	{
+		{ "sin",  -8192.0, 8192.0, 1.5e-7, false, false, [](float x) { return fastSin(x); },  [](double x) { return std::sin(x); } },
+		{ "cos",  -8192.0, 8192.0, 1.5e-7, false, false, [](float x) { return fastCos(x); },  [](double x) { return std::cos(x); } },
+		{ "exp",  -87.0,   88.0,   3e-7,   true,  false, [](float x) { return fastExp(x); },  [](double x) { return std::exp(x); } },
+		{ "exp2", -126.0,  127.0,  3e-7,   true,  false, [](float x) { return fastExp2(x); }, [](double x) { return std::exp2(x); } },
+		{ "log2", 0.5,     2.0,    3e-7,   false, false, [](float x) { return fastLog2(x); }, [](double x) { return std::log2(x); } },
+		{ "log2", 2.0,     1e30,   1.5e-7, true,  true,  [](float x) { return fastLog2(x); }, [](double x) { return std::log2(x); } },
+		{ "log2", 1e-30,   0.5,    1.5e-7, true,  true,  [](float x) { return fastLog2(x); }, [](double x) { return std::log2(x); } }
+	};
+
+	bool is_passed = true;
+
+	for (const auto& check : checks)
+		is_passed = run(check, samples) && is_passed;
+
+	return is_passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,147 @@
+// Check, that the disabled instrumentation costs nothing
+//
+// Build it twice from the same .cpp files of the repository, both times
+// with PARTICLE_SYSTEM_PROFILING defined: once as is, and once with
+// -DPARTICLE_SYSTEM_INSTRUMENTATION=0 for all of them. The disabled build
+// asserts at compile time, that the scope macros expand to nothing, so
+// the hot loops are token for token the ones without any instrumentation,
+// and at run time, that nothing was recorded: the costs, the high-water
+// mark, the histograms and the trace stay empty (the enabled build checks,
+// that all of them are recorded). Both builds time the same scenario and
+// print one JSON line; the difference of their ns/particle is the price
+// of the enabled instrumentation.
+//
+// That the disabled build is the one without any instrumentation is
+// checked on the code itself by the check_instrumentation_bare test of
+// CMakeLists.txt: tools/StripInstrumentation.cmake cuts the scopes and
+// the instrumented blocks out of a copy of ParticleSystem.cpp, and
+// tools/CompareObjects.cmake compares its object with the =0 one.
+//
+// Usage:
+// CheckInstrumentation [--frames N]
+
+#include "../ParticleSystem.hpp"
+#include "../ParticleProfiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#define PARTICLE_STRINGIFY_IMPL(...) #__VA_ARGS__
+#define PARTICLE_STRINGIFY(...) PARTICLE_STRINGIFY_IMPL(__VA_ARGS__)
+
+#if !PARTICLE_SYSTEM_INSTRUMENTATION
+// The arguments are expanded first, so the empty expansion gives ""
+static_assert(sizeof(PARTICLE_STRINGIFY(PARTICLE_COST_SCOPE(m_cost.update_time))) == 1, "PARTICLE_COST_SCOPE must expand to nothing");
+static_assert(sizeof(PARTICLE_STRINGIFY(PARTICLE_PROFILE_SCOPE("update"))) == 1, "PARTICLE_PROFILE_SCOPE must expand to nothing");
+#endif
+
+namespace
+{
+	constexpr float dt = 1.0f / 60.0f;
+
+	double elapsedNs(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	std::size_t getTraceEvents()
+	{
+		std::ostringstream trace;
+		ParticleProfiler::getInstance().writeChromeTrace(trace);
+
+		std::string text = trace.str();
+		std::size_t events = 0;
+
+		for (std::size_t position = text.find("\"name\""); position != std::string::npos; position = text.find("\"name\"", position + 1))
+			++events;
+
+		return events;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	std::size_t frames = 600;
+
+	if (argc == 3 && !std::strcmp(argv[1], "--frames"))
+		frames = std::max(1ul, std::strtoul(argv[2], nullptr, 10));
+	else if (argc != 1)
+	{
+		std::cerr << "Usage: " << argv[0] << " [--frames N]\n";
+
+		return EXIT_FAILURE;
+	}
+
+	ParticleSystem system;
+
+	system.setSeed(1);
+	system.setRespawnRate(10000.0f);
+	system.setVelocityRange(20.0f, 200.0f);
+	system.setDispersion(sf::degrees(180.0f));
+	system.setLifeTimeRange(1.0f, 2.0f);
+	system.setAngularVelocityRange(sf::degrees(-90.0f), sf::degrees(90.0f));
+	system.setAttenuated(true);
+	system.setHistograms(true);
+	system.setEmitted(true);
+
+	// Up to the steady population
+	for (float time = 0.0f; time < 3.0f; time += dt)
+		system.update(dt);
+
+	double update_ns = 0.0;
+	double vertices_ns = 0.0;
+	double particle_frames = 0.0;
+
+	for (std::size_t frame = 0; frame < frames; ++frame)
+	{
+		auto start = std::chrono::steady_clock::now();
+		system.update(dt);
+		update_ns += elapsedNs(start);
+
+		start = std::chrono::steady_clock::now();
+		system.getVertices();
+		vertices_ns += elapsedNs(start);
+
+		particle_frames += system.getParticleCount();
+	}
+
+	particle_frames = std::max(particle_frames, 1.0);
+
+	const ParticleSystem::Cost& cost = system.getCost();
+	std::size_t trace_events = getTraceEvents();
+	std::uint64_t histogram_samples = system.getPopulationHistogram().getTotal() + system.getLifetimeHistogram().getTotal();
+
+	bool is_recorded = cost.update_time > 0 && cost.particle_seconds > 0.0 && system.getHighWaterMark() > 0 && histogram_samples > 0;
+	bool is_empty = cost.update_time == 0 && cost.particle_seconds == 0.0 && system.getHighWaterMark() == 0 && histogram_samples == 0;
+
+#if defined(PARTICLE_SYSTEM_PROFILING)
+	is_recorded = is_recorded && trace_events > 0;
+#endif
+
+	is_empty = is_empty && trace_events == 0;
+
+	bool is_passed = PARTICLE_SYSTEM_INSTRUMENTATION ? is_recorded : is_empty;
+
+	std::cout << "{\"instrumentation\":" << PARTICLE_SYSTEM_INSTRUMENTATION
+#if defined(PARTICLE_SYSTEM_PROFILING)
+		<< ",\"profiling\":true"
+#else
+		<< ",\"profiling\":false"
+#endif
+		<< ",\"particles\":" << particle_frames / frames
+		<< ",\"update_ns_per_particle\":" << update_ns / particle_frames
+		<< ",\"vertices_ns_per_particle\":" << vertices_ns / particle_frames
+		<< ",\"update_time\":" << cost.update_time
+		<< ",\"high_water_mark\":" << system.getHighWaterMark()
+		<< ",\"histogram_samples\":" << histogram_samples
+		<< ",\"trace_events\":" << trace_events
+		<< ",\"passed\":" << (is_passed ? "true" : "false")
+		<< "}\n";
+
+	return is_passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,308 @@
+// Statistical and speed check of ParticleRandom
+//
+// Fills large arrays with every distribution of the generator and
+// tests them: the mean and the variance against their expected values
+// (within 5 standard errors), and the histogram against the expected
+// one by the chi-square test (at the significance of 1e-4). The unit
+// vectors must also have the unit length. Each fill is timed against
+// the rand() path, that the particles used before: a rand() call per
+// value, and the libm for the normal values and the vectors.
+// Prints one JSON line per distribution.
+//
+// Usage:
+// CheckRandom [--samples N]
+
+#include "../ParticleRandom.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+	constexpr std::size_t bins = 64;
+	constexpr double two_pi = 6.283185307179586;
+
+	// Keeps the optimizer from dropping the timed loops
+	volatile float sink;
+
+	struct Statistics
+	{
+		double mean = 0.0;
+		double variance = 0.0;
+	};
+
+	Statistics getStatistics(const std::vector<float>& values)
+	{
+		Statistics statistics;
+
+		for (float value : values)
+			statistics.mean += value;
+
+		statistics.mean /= values.size();
+
+		for (float value : values)
+			statistics.variance += (value - statistics.mean) * (value - statistics.mean);
+
+		statistics.variance /= values.size() - 1;
+
+		return statistics;
+	}
+
+	// Chi-square of the histogram, the expected probabilities of the bins sum up to 1
+	double getChiSquare(const std::vector<std::size_t>& histogram, const std::vector<double>& probabilities, std::size_t samples)
+	{
+		double chi_square = 0.0;
+
+		for (std::size_t i = 0; i < histogram.size(); ++i)
+		{
+			double expected = probabilities[i] * samples;
+			chi_square += (histogram[i] - expected) * (histogram[i] - expected) / expected;
+		}
+
+		return chi_square;
+	}
+
+	// Critical value at the significance of 1e-4 (Wilson-Hilferty)
+	double getChiSquareBound(std::size_t degrees)
+	{
+		constexpr double z = 3.719;
+		double k = static_cast<double>(degrees);
+		double a = 2.0 / (9.0 * k);
+
+		return k * std::pow(1.0 - a + z * std::sqrt(a), 3.0);
+	}
+
+	double elapsedNs(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// ns per value of the function, that fills the array
+	template <typename Fill>
+	double time(std::vector<float>& values, Fill fill)
+	{
+		auto start = std::chrono::steady_clock::now();
+		fill();
+		double ns = elapsedNs(start) / values.size();
+
+		sink = values[values.size() / 2];
+
+		return ns;
+	}
+
+	float frand(float min, float max)
+	{
+		return static_cast<float>(rand()) / RAND_MAX * (max - min) + min;
+	}
+
+	void printLine(const char* name, std::size_t samples, const Statistics& statistics, double expected_mean, double expected_variance,
+		double chi_square, double chi_square_bound, double ns, double rand_ns, bool is_passed)
+	{
+		std::cout << "{\"distribution\":\"" << name << '"'
+			<< ",\"samples\":" << samples
+			<< ",\"mean\":" << statistics.mean
+			<< ",\"expected_mean\":" << expected_mean
+			<< ",\"variance\":" << statistics.variance
+			<< ",\"expected_variance\":" << expected_variance
+			<< ",\"chi_square\":" << chi_square
+			<< ",\"chi_square_bound\":" << chi_square_bound
+			<< ",\"ns_per_value\":" << ns
+			<< ",\"rand_ns_per_value\":" << rand_ns
+			<< ",\"passed\":" << (is_passed ? "true" : "false")
+			<< "}\n";
+	}
+
+	// The mean and the variance are within 5 standard errors
+	bool isClose(const Statistics& statistics, double mean, double variance, double kurtosis, std::size_t samples)
+	{
+		double mean_error = 5.0 * std::sqrt(variance / samples);
+		double variance_error = 5.0 * variance * std::sqrt((kurtosis - 1.0) / samples);
+
+		return std::fabs(statistics.mean - mean) <= mean_error && std::fabs(statistics.variance - variance) <= variance_error;
+	}
+
+	bool checkUniform(std::size_t samples)
+	{
+		constexpr float min = -3.0f;
+		constexpr float max = 5.0f;
+
+		ParticleRandom random(1);
+		std::vector<float> values(samples);
+
+		double ns = time(values, [&]() { random.fillUniform(values.data(), samples, min, max); });
+
+		std::vector<std::size_t> histogram(bins, 0);
+		bool is_in_range = true;
+
+		for (float value : values)
+		{
+			is_in_range = is_in_range && value >= min && value < max;
+			++histogram[std::min(bins - 1, static_cast<std::size_t>((value - min) / (max - min) * bins))];
+		}
+
+		Statistics statistics = getStatistics(values);
+		double chi_square = getChiSquare(histogram, std::vector<double>(bins, 1.0 / bins), samples);
+		double chi_square_bound = getChiSquareBound(bins - 1);
+
+		std::vector<float> rand_values(samples);
+		double rand_ns = time(rand_values, [&]()
+		{
+			for (float& value : rand_values)
+				value = frand(min, max);
+		});
+
+		double mean = (min + max) * 0.5;
+		double variance = (max - min) * (max - min) / 12.0;
+		bool is_passed = is_in_range && chi_square <= chi_square_bound && isClose(statistics, mean, variance, 1.8, samples);
+
+		printLine("uniform", samples, statistics, mean, variance, chi_square, chi_square_bound, ns, rand_ns, is_passed);
+
+		return is_passed;
+	}
+
+	bool checkNormal(std::size_t samples)
+	{
+		constexpr float mean = 2.0f;
+		constexpr float deviation = 3.0f;
+
+		ParticleRandom random(1);
+		std::vector<float> values(samples);
+
+		double ns = time(values, [&]() { random.fillNormal(values.data(), samples, mean, deviation); });
+
+		// The bins span 4 deviations around the mean, the outer ones take the tails
+		std::vector<std::size_t> histogram(bins, 0);
+		std::vector<double> probabilities(bins);
+		bool is_finite = true;
+
+		auto cdf = [](double x) { return 0.5 * std::erfc(-x / std::sqrt(2.0)); };
+
+		for (std::size_t i = 0; i < bins; ++i)
+		{
+			double low = (i == 0) ? -INFINITY : -4.0 + 8.0 * i / bins;
+			double high = (i == bins - 1) ? INFINITY : -4.0 + 8.0 * (i + 1) / bins;
+
+			probabilities[i] = cdf(high) - cdf(low);
+		}
+
+		for (float value : values)
+		{
+			is_finite = is_finite && std::isfinite(value);
+
+			double z = (value - mean) / deviation;
+			auto bin = static_cast<std::ptrdiff_t>(std::floor((z + 4.0) / 8.0 * bins));
+
+			++histogram[std::clamp<std::ptrdiff_t>(bin, 0, bins - 1)];
+		}
+
+		Statistics statistics = getStatistics(values);
+		double chi_square = getChiSquare(histogram, probabilities, samples);
+		double chi_square_bound = getChiSquareBound(bins - 1);
+
+		std::vector<float> rand_values(samples);
+		double rand_ns = time(rand_values, [&]()
+		{
+			for (std::size_t i = 0; i + 1 < samples; i += 2)
+			{
+				float radius = std::sqrt(-2.0f * std::log(frand(1e-7f, 1.0f))) * deviation;
+				float angle = frand(0.0f, static_cast<float>(two_pi));
+
+				rand_values[i] = radius * std::cos(angle) + mean;
+				rand_values[i + 1] = radius * std::sin(angle) + mean;
+			}
+		});
+
+		double variance = deviation * deviation;
+		bool is_passed = is_finite && chi_square <= chi_square_bound && isClose(statistics, mean, variance, 3.0, samples);
+
+		printLine("normal", samples, statistics, mean, variance, chi_square, chi_square_bound, ns, rand_ns, is_passed);
+
+		return is_passed;
+	}
+
+	bool checkUnitVectors(std::size_t samples)
+	{
+		ParticleRandom random(1);
+		std::vector<float> x(samples), y(samples);
+
+		double ns = time(x, [&]() { random.fillUnitVectors(x.data(), y.data(), samples); });
+
+		// The histogram of the angles must be flat
+		std::vector<std::size_t> histogram(bins, 0);
+		double length_error = 0.0;
+
+		for (std::size_t i = 0; i < samples; ++i)
+		{
+			length_error = std::max(length_error, std::fabs(std::hypot(x[i], y[i]) - 1.0));
+
+			double angle = std::atan2(y[i], x[i]) + two_pi * 0.5;
+			++histogram[std::min(bins - 1, static_cast<std::size_t>(angle / two_pi * bins))];
+		}
+
+		// Both components have the mean of 0 and the variance of 1/2
+		Statistics statistics_x = getStatistics(x);
+		Statistics statistics_y = getStatistics(y);
+		double chi_square = getChiSquare(histogram, std::vector<double>(bins, 1.0 / bins), samples);
+		double chi_square_bound = getChiSquareBound(bins - 1);
+
+		std::vector<float> rand_x(samples), rand_y(samples);
+		double rand_ns = time(rand_x, [&]()
+		{
+			for (std::size_t i = 0; i < samples; ++i)
+			{
+				float angle = frand(0.0f, static_cast<float>(two_pi));
+
+				rand_x[i] = std::cos(angle);
+				rand_y[i] = std::sin(angle);
+			}
+		});
+
+		sink = rand_y[samples / 2];
+
+		bool is_passed = length_error <= 1e-6 && chi_square <= chi_square_bound
+			&& isClose(statistics_x, 0.0, 0.5, 1.5, samples) && isClose(statistics_y, 0.0, 0.5, 1.5, samples);
+
+		std::cout << "{\"distribution\":\"unit_vectors\""
+			<< ",\"samples\":" << samples
+			<< ",\"mean_x\":" << statistics_x.mean
+			<< ",\"mean_y\":" << statistics_y.mean
+			<< ",\"variance_x\":" << statistics_x.variance
+			<< ",\"variance_y\":" << statistics_y.variance
+			<< ",\"length_error\":" << length_error
+			<< ",\"chi_square\":" << chi_square
+			<< ",\"chi_square_bound\":" << chi_square_bound
+			<< ",\"ns_per_value\":" << ns
+			<< ",\"rand_ns_per_value\":" << rand_ns
+			<< ",\"passed\":" << (is_passed ? "true" : "false")
+			<< "}\n";
+
+		return is_passed;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	std::size_t samples = 1 << 22;
+
+	if (argc == 3 && !std::strcmp(argv[1], "--samples"))
+		samples = std::max(1ul << 12, std::strtoul(argv[2], nullptr, 10));
+	else if (argc != 1)
+	{
+		std::cerr << "Usage: " << argv[0] << " [--samples N]\n";
+
+		return EXIT_FAILURE;
+	}
+
+	srand(1);
+
+	bool is_passed = checkUniform(samples);
+	is_passed = checkNormal(samples) && is_passed;
+	is_passed = checkUnitVectors(samples) && is_passed;
+
+	return is_passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
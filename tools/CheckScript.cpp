@@ -0,0 +1,134 @@
+// Check, that ParticleScheduler resumes the scripts at the right updates
+//
+// The scripts count their resumptions: the ones, that await the bursts
+// of zero seconds and the delays shorter than the step, in a loop, must
+// be resumed exactly once per update (the timers, that are added within
+// an update, wait for the next one), and the burst must stop the emission
+// of its system at its end, before the script goes on. Prints one JSON
+// line per check.
+//
+// Usage:
+// CheckScript [--frames N]
+
+#include "../ParticleScript.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+	constexpr float dt = 1.0f / 64.0f;
+
+	ParticleScript loopBursts(ParticleSystem& system, std::size_t& resumes)
+	{
+		for (;;)
+		{
+			++resumes;
+			co_await burst(system, 100.0f, 0.0f);
+		}
+	}
+
+	ParticleScript loopDelays(std::size_t& resumes)
+	{
+		for (;;)
+		{
+			++resumes;
+			co_await delay(dt * 0.25f);
+		}
+	}
+
+	ParticleScript burstOnce(ParticleSystem& system, bool& is_emitted_after)
+	{
+		co_await burst(system, 100.0f, 4.0f * dt);
+		is_emitted_after = system.isEmitted();
+	}
+
+	void printLine(const char* name, std::size_t value, std::size_t expected, bool is_passed)
+	{
+		std::cout << "{\"check\":\"" << name << '"'
+			<< ",\"value\":" << value
+			<< ",\"expected\":" << expected
+			<< ",\"passed\":" << (is_passed ? "true" : "false")
+			<< "}\n";
+	}
+
+	// The start resumes the script once, each update once more
+	bool checkLoop(const char* name, std::size_t frames, ParticleScheduler& scheduler, const std::size_t& resumes)
+	{
+		for (std::size_t frame = 0; frame < frames; ++frame)
+			scheduler.update(dt);
+
+		bool is_passed = resumes == frames + 1;
+
+		printLine(name, resumes, frames + 1, is_passed);
+
+		return is_passed;
+	}
+
+	bool checkBursts(std::size_t frames)
+	{
+		ParticleSystem system;
+		ParticleScheduler scheduler;
+		std::size_t resumes = 0;
+
+		scheduler.start(loopBursts(system, resumes));
+
+		return checkLoop("zero_bursts", frames, scheduler, resumes);
+	}
+
+	bool checkDelays(std::size_t frames)
+	{
+		ParticleScheduler scheduler;
+		std::size_t resumes = 0;
+
+		scheduler.start(loopDelays(resumes));
+
+		return checkLoop("short_delays", frames, scheduler, resumes);
+	}
+
+	// The amount of the updates, until the script finishes
+	bool checkBurstEnd()
+	{
+		ParticleSystem system;
+		ParticleScheduler scheduler;
+		bool is_emitted_after = true;
+
+		scheduler.start(burstOnce(system, is_emitted_after));
+
+		bool is_emitted_before = system.isEmitted();
+		std::size_t updates = 0;
+
+		while (scheduler.getScriptCount() != 0 && updates < 64)
+		{
+			scheduler.update(dt);
+			++updates;
+		}
+
+		bool is_passed = is_emitted_before && !is_emitted_after && updates == 4;
+
+		printLine("burst_end", updates, 4, is_passed);
+
+		return is_passed;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	std::size_t frames = 1000;
+
+	if (argc == 3 && !std::strcmp(argv[1], "--frames"))
+		frames = std::strtoul(argv[2], nullptr, 10);
+	else if (argc != 1)
+	{
+		std::cerr << "Usage: " << argv[0] << " [--frames N]\n";
+
+		return EXIT_FAILURE;
+	}
+
+	bool is_passed = checkBursts(frames);
+	is_passed = checkDelays(frames) && is_passed;
+	is_passed = checkBurstEnd() && is_passed;
+
+	return is_passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,692 @@
+// A/B comparison of ParticleSystem with the legacy particle system
+//
+// LegacySystem below is the particle system of the first version of the
+// repository: a std::list of the heap allocated particles, each one with
+// its own sprite, moved one by one and drawn with a draw call per sprite.
+// It is kept as the reference: the same scenarios run through it and through
+// every mode of ParticleSystem (the SoA storage with the libm, with the fast
+// math, and the deterministic fixed-point one), the tool reports the speedups
+// and compares the drawn quads, their centers, sizes and colors, within
+// the tolerance (0.05 pixels by default, the fixed-point positions drift
+// by up to 0.02 from the float ones over the compared frames). Prints one JSON line per scenario and mode, and fails,
+// if any quad doesn't match.
+//
+// The random numbers of the two systems differ, so the compared scenarios
+// only use the fixed values (no dispersion, no respawn area, the lifetime
+// of a second), the quads are compared regardless of their random rotation,
+// and only before the first particle dies (the legacy one dies a frame later).
+// The time step is 1/64, exact in floats and in Q16.16, so both systems
+// spawn the same number of particles every frame.
+//
+// The legacy sprite is a sf::Transformable with the size of its texture:
+// without a window there is neither a texture nor a render target, so its
+// draw is measured up to the transformed vertices of every sprite, that the
+// render target computes on the CPU before each draw call. The GL calls
+// aren't counted, the speedups are the lower bounds.
+//
+// The last line compares the drag and the gravity of a fountain run by
+// ParticleSystem::setDrag and setAcceleration with the same motion written
+// as a behavior (ParticleExpression): the positions must match within the
+// tolerance, and the behavior must update within 3 times the native cost.
+//
+// With --counters, the hardware counters (see PerfCounters.hpp) are read
+// around the update and the draw (the vertex generation) of every frame
+// of both systems and written per particle. The reads add their own cost
+// to the times, so take the speedups from the runs without them.
+//
+// Usage:
+// CompareLegacy [--repeat N] [--tolerance T] [--counters]
+
+#define _USE_MATH_DEFINES
+
+#include "../ParticleSystem.hpp"
+#include "../PerfCounters.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+	constexpr float dt = 1.0f / 64.0f;
+
+	const sf::Vector2f particle_size(32.0f, 32.0f);
+
+	// External random generators of the legacy system
+
+	constexpr float inv_rand_max = 1.0f / RAND_MAX;
+
+	float frand(float min, float max)
+	{
+		float fval = static_cast<float>(rand());
+
+		return (fval * inv_rand_max * (max - min) + min);
+	}
+
+	float frand(float bound)
+	{
+		return frand(-bound, bound);
+	}
+
+	sf::Vector2f rand2f(const sf::Vector2f& factors)
+	{
+		return sf::Vector2f(frand(factors.x), frand(factors.y));
+	}
+
+	// The reference, see the comment at the top
+	class LegacySystem
+	{
+	public:
+		void setEmitter(const sf::Vector2f& emitter)         { m_emitter = emitter; }
+		void setDirection(sf::Angle direction)              { m_direction = direction; }
+		void setDispersion(sf::Angle dispersion)            { m_dispersion = dispersion; }
+		void setVelocity(float velocity)                    { m_velocity = std::fabs(velocity); }
+		void setRespawnRate(float rate)                     { m_rate = std::fabs(rate); }
+		void setRespawnArea(const sf::Vector2f& area)       { m_respawn_area = area; }
+		void setLifeTime(float lifetime)                    { m_lifetime_max = std::fabs(lifetime); }
+		void setExponentialGrowth(const sf::Vector2f& factors) { m_exponential_growth = factors; }
+		void setEmitted(bool emitted)                       { m_is_emitted = emitted; }
+
+		void setExplosion(std::size_t splash_amount, float radius)
+		{
+			if (!m_particles.empty())
+				return;
+
+			setEmitted(false);
+
+			float offset = M_PI * 2 / splash_amount;
+
+			for (std::size_t i = 0; i < splash_amount; ++i)
+			{
+				auto particle = std::make_unique<Particle>();
+				particle->sprite.setOrigin(particle_size * 0.5f);
+
+				float dir = i * offset;
+				float sine = std::sin(dir);
+				float cosine = std::cos(dir);
+
+				particle->sprite.setPosition(sf::Vector2f(cosine * radius + m_emitter.x, sine * radius + m_emitter.y));
+				particle->velocity = sf::Vector2f(cosine * m_velocity, sine * m_velocity);
+				particle->lifetime = frand(0, m_lifetime_max) + 1.0f;
+
+				m_particles.push_back(std::move(particle));
+			}
+		}
+
+		void update(float dt)
+		{
+			if (m_is_emitted)
+				m_timer += m_rate * dt;
+
+			while (m_timer > 1.0f)
+			{
+				m_timer -= 1.0f;
+				createParticle();
+			}
+
+			for (auto p = m_particles.begin(); p != m_particles.end();)
+			{
+				Particle& particle = **p;
+
+				if (particle.lifetime > 0.0f)
+				{
+					particle.sprite.move(particle.velocity * dt);
+					particle.sprite.scale(m_exponential_growth);
+					particle.lifetime -= dt;
+					++p;
+				}
+				else
+					p = m_particles.erase(p);
+			}
+		}
+
+		// One draw call of 4 vertices per sprite, the vertices go to the target
+		void draw(std::vector<sf::Vertex>& target) const
+		{
+			target.clear();
+
+			for (const auto& particle : m_particles)
+			{
+				const sf::Transform& transform = particle->sprite.getTransform();
+
+				target.push_back(sf::Vertex{transform.transformPoint(sf::Vector2f(0.0f, 0.0f)), particle->color, sf::Vector2f(0.0f, 0.0f)});
+				target.push_back(sf::Vertex{transform.transformPoint(sf::Vector2f(particle_size.x, 0.0f)), particle->color, sf::Vector2f(particle_size.x, 0.0f)});
+				target.push_back(sf::Vertex{transform.transformPoint(particle_size), particle->color, particle_size});
+				target.push_back(sf::Vertex{transform.transformPoint(sf::Vector2f(0.0f, particle_size.y)), particle->color, sf::Vector2f(0.0f, particle_size.y)});
+			}
+		}
+
+		std::size_t getParticleCount() const
+		{
+			return m_particles.size();
+		}
+
+	private:
+		struct Particle
+		{
+			sf::Vector2f      velocity;
+			float             lifetime = 0.0f;
+			sf::Transformable sprite;
+			sf::Color         color = sf::Color::White;
+		};
+
+		void createParticle()
+		{
+			auto particle = std::make_unique<Particle>();
+			particle->sprite.setOrigin(particle_size * 0.5f);
+
+			float half_disp = (m_dispersion * 0.5f).asDegrees();
+			float random = frand(-half_disp, half_disp);
+			float angle = (m_direction + sf::degrees(random)).asRadians();
+
+			particle->velocity.x = std::cos(angle) * m_velocity;
+			particle->velocity.y = std::sin(angle) * m_velocity;
+
+			particle->lifetime = frand(0, m_lifetime_max) + 1.0f;
+
+			particle->sprite.setPosition(m_emitter + rand2f(m_respawn_area));
+			particle->sprite.setRotation(sf::degrees(frand(0.0f, 360.0f)));
+
+			m_particles.push_back(std::move(particle));
+		}
+
+		std::list<std::unique_ptr<Particle>> m_particles;
+
+		sf::Vector2f m_emitter;
+		sf::Vector2f m_respawn_area;
+		sf::Vector2f m_exponential_growth = sf::Vector2f(1.0f, 1.0f);
+
+		sf::Angle m_direction;
+		sf::Angle m_dispersion;
+
+		float m_velocity     = 0.0f;
+		float m_lifetime_max = 0.0f;
+		float m_rate         = 0.0f;
+		float m_timer        = 0.0f;
+
+		bool m_is_emitted = false;
+	};
+
+	struct Scenario
+	{
+		const char*  name;
+		std::size_t  frames;
+		bool         is_compared; // uses only the fixed values, see the comment at the top
+
+		std::size_t  explosion; // particles, 0 for the emission
+		float        radius;
+		float        rate;
+		float        velocity;
+		float        direction;
+		float        dispersion;
+		sf::Vector2f respawn_area;
+		float        lifetime;
+		sf::Vector2f growth;
+	};
+
+	struct Mode
+	{
+		const char* name;
+		bool        is_fast_math;
+		bool        is_deterministic;
+	};
+
+	template <typename System>
+	void setup(System& system, const Scenario& scenario)
+	{
+		system.setEmitter(sf::Vector2f(960.0f, 540.0f));
+		system.setDirection(sf::degrees(scenario.direction));
+		system.setDispersion(sf::degrees(scenario.dispersion));
+		system.setVelocity(scenario.velocity);
+		system.setRespawnRate(scenario.rate);
+		system.setRespawnArea(scenario.respawn_area);
+		system.setLifeTime(scenario.lifetime);
+		system.setExponentialGrowth(scenario.growth);
+
+		if (scenario.explosion)
+			system.setExplosion(scenario.explosion, scenario.radius);
+		else
+			system.setEmitted(true);
+	}
+
+	void setup(ParticleSystem& system, const Scenario& scenario, const Mode& mode)
+	{
+		system.setSeed(1);
+		system.setParticleSize(particle_size);
+		system.setFastMath(mode.is_fast_math);
+		system.setDeterministic(mode.is_deterministic);
+
+		setup(system, scenario);
+	}
+
+	// The drawn quad without its rotation
+	struct Quad
+	{
+		sf::Vector2f center;
+		sf::Vector2f size;
+		sf::Color    color;
+	};
+
+	// The corners go around the quad
+	Quad makeQuad(const sf::Vertex& a, const sf::Vertex& b, const sf::Vertex& c, const sf::Vertex& d)
+	{
+		auto length = [](const sf::Vector2f& v) { return std::sqrt(v.x * v.x + v.y * v.y); };
+
+		Quad quad;
+		quad.center = (a.position + c.position) * 0.5f;
+		quad.size = sf::Vector2f(length(b.position - a.position), length(d.position - a.position));
+		quad.color = a.color;
+
+		return quad;
+	}
+
+	struct Comparison
+	{
+		std::size_t quads      = 0;
+		std::size_t mismatched = 0;
+		float position_error   = 0.0f;
+		float size_error       = 0.0f;
+		int   color_error      = 0;
+	};
+
+	float getError(const sf::Vector2f& a, const sf::Vector2f& b)
+	{
+		return std::max(std::fabs(a.x - b.x), std::fabs(a.y - b.y));
+	}
+
+	int getError(const sf::Color& a, const sf::Color& b)
+	{
+		return std::max({ std::abs(a.r - b.r), std::abs(a.g - b.g), std::abs(a.b - b.b), std::abs(a.a - b.a) });
+	}
+
+	// Matches every legacy quad with a free one of the system, the closest
+	// by the center among the ones within the tolerance in x
+	void compare(std::vector<Quad> legacy, std::vector<Quad> quads, float tolerance, Comparison& comparison)
+	{
+		auto by_x = [](const Quad& a, const Quad& b) { return a.center.x < b.center.x; };
+
+		std::sort(legacy.begin(), legacy.end(), by_x);
+		std::sort(quads.begin(), quads.end(), by_x);
+
+		std::vector<bool> is_matched(quads.size(), false);
+		std::size_t matched = 0;
+
+		for (const Quad& quad : legacy)
+		{
+			Quad low;
+			low.center.x = quad.center.x - tolerance;
+
+			auto first = std::lower_bound(quads.begin(), quads.end(), low, by_x);
+			std::size_t best = quads.size();
+			float best_error = tolerance;
+
+			for (auto other = first; other != quads.end() && other->center.x <= quad.center.x + tolerance; ++other)
+			{
+				std::size_t index = static_cast<std::size_t>(other - quads.begin());
+				float error = getError(quad.center, other->center);
+
+				if (!is_matched[index] && error <= best_error)
+				{
+					best = index;
+					best_error = error;
+				}
+			}
+
+			if (best == quads.size())
+				continue;
+
+			const Quad& other = quads[best];
+			float size_error = getError(quad.size, other.size);
+			int color_error = getError(quad.color, other.color);
+
+			comparison.position_error = std::max(comparison.position_error, best_error);
+			comparison.size_error = std::max(comparison.size_error, size_error);
+			comparison.color_error = std::max(comparison.color_error, color_error);
+
+			if (size_error > tolerance || color_error > 0)
+				continue;
+
+			is_matched[best] = true;
+			++matched;
+		}
+
+		comparison.quads += legacy.size();
+		comparison.mismatched += legacy.size() - matched + quads.size() - matched;
+	}
+
+	// Runs both systems in lockstep and compares the quads on a few frames
+	Comparison compare(const Scenario& scenario, const Mode& mode, float tolerance)
+	{
+		srand(1);
+
+		LegacySystem legacy;
+		ParticleSystem system;
+
+		setup(legacy, scenario);
+		setup(system, scenario, mode);
+
+		std::vector<sf::Vertex> legacy_vertices;
+		std::vector<Quad> legacy_quads, quads;
+		Comparison comparison;
+
+		for (std::size_t frame = 1; frame <= scenario.frames; ++frame)
+		{
+			legacy.update(dt);
+			system.update(dt);
+
+			if (frame != 1 && frame != scenario.frames / 2 && frame != scenario.frames)
+				continue;
+
+			legacy.draw(legacy_vertices);
+			const auto& vertices = system.getVertices();
+
+			legacy_quads.clear();
+			quads.clear();
+
+			for (std::size_t i = 0; i + 3 < legacy_vertices.size(); i += 4)
+				legacy_quads.push_back(makeQuad(legacy_vertices[i], legacy_vertices[i + 1], legacy_vertices[i + 2], legacy_vertices[i + 3]));
+
+			for (std::size_t i = 0; i + 5 < vertices.size(); i += 6)
+				quads.push_back(makeQuad(vertices[i], vertices[i + 1], vertices[i + 2], vertices[i + 5]));
+
+			compare(legacy_quads, quads, tolerance, comparison);
+		}
+
+		return comparison;
+	}
+
+	struct Timing
+	{
+		double ns              = 0.0;
+		double particle_frames = 0.0;
+
+		PerfCounters::Sample update_counters; // in total, with --counters
+		PerfCounters::Sample draw_counters;   // in total, with --counters
+
+		double getNsPerParticle() const { return ns / std::max(particle_frames, 1.0); }
+	};
+
+	double elapsedNs(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// The update and the draw of every frame, the counters are nullptr, unless they are read
+	Timing timeLegacy(const Scenario& scenario, std::size_t repeat, PerfCounters* counters)
+	{
+		Timing timing;
+		std::vector<sf::Vertex> vertices;
+
+		for (std::size_t run = 0; run < repeat; ++run)
+		{
+			srand(1);
+
+			LegacySystem legacy;
+			auto start = std::chrono::steady_clock::now();
+
+			setup(legacy, scenario);
+
+			for (std::size_t frame = 0; frame < scenario.frames; ++frame)
+			{
+				PerfCounters::measure(counters, timing.update_counters, [&]() { legacy.update(dt); });
+				PerfCounters::measure(counters, timing.draw_counters, [&]() { legacy.draw(vertices); });
+				timing.particle_frames += legacy.getParticleCount();
+			}
+
+			timing.ns += elapsedNs(start);
+		}
+
+		return timing;
+	}
+
+	Timing timeSystem(const Scenario& scenario, const Mode& mode, std::size_t repeat, PerfCounters* counters)
+	{
+		Timing timing;
+
+		for (std::size_t run = 0; run < repeat; ++run)
+		{
+			ParticleSystem system;
+			auto start = std::chrono::steady_clock::now();
+
+			setup(system, scenario, mode);
+
+			for (std::size_t frame = 0; frame < scenario.frames; ++frame)
+			{
+				PerfCounters::measure(counters, timing.update_counters, [&]() { system.update(dt); });
+				PerfCounters::measure(counters, timing.draw_counters, [&]() { system.getVertices(); });
+				timing.particle_frames += system.getParticleCount();
+			}
+
+			timing.ns += elapsedNs(start);
+		}
+
+		return timing;
+	}
+
+	constexpr float  drag            = 0.5f;
+	constexpr float  gravity         = 98.0f;
+	constexpr double max_drag_ratio  = 3.0;
+
+	// The semi-implicit Euler of ParticleSystem::move with the drag and the gravity:
+	// the behavior runs after the integration without them, so it moves
+	// the positions back by the part of the velocity, that the drag takes
+	std::string getDragSource()
+	{
+		std::ostringstream source;
+		source << std::setprecision(9);
+
+		float damping = std::exp(-drag * dt);
+
+		source << "d = " << damping << "; g = " << gravity << ";"
+			<< " x = x + vx * (d - 1) * dt; y = y + (vy * (d - 1) + g * dt) * dt;"
+			<< " vx = vx * d; vy = vy * d + g * dt";
+
+		return source.str();
+	}
+
+	// The fountain of the scenarios, with the native drag and gravity, unless the behavior is given
+	void setupDrag(ParticleSystem& system, const ParticleExpression* behavior)
+	{
+		system.setSeed(1);
+		system.setParticleSize(particle_size);
+		system.setEmitter(sf::Vector2f(960.0f, 540.0f));
+		system.setDirection(sf::degrees(-90.0f));
+		system.setDispersion(sf::degrees(60.0f));
+		system.setVelocity(300.0f);
+		system.setRespawnRate(6400.0f);
+		system.setLifeTime(1.0f);
+		system.setEmitted(true);
+
+		if (behavior)
+			system.setBehavior(behavior);
+		else
+		{
+			system.setDrag(drag);
+			system.setAcceleration(sf::Vector2f(0.0f, gravity));
+		}
+	}
+
+	// The updates only, the vertices are the same for both
+	Timing timeDrag(const ParticleExpression* behavior, std::size_t frames, std::size_t repeat, PerfCounters* counters)
+	{
+		Timing timing;
+
+		for (std::size_t run = 0; run < repeat; ++run)
+		{
+			ParticleSystem system;
+			setupDrag(system, behavior);
+
+			for (std::size_t frame = 0; frame < frames; ++frame)
+			{
+				auto start = std::chrono::steady_clock::now();
+				PerfCounters::measure(counters, timing.update_counters, [&]() { system.update(dt); });
+				timing.ns += elapsedNs(start);
+				timing.particle_frames += system.getParticleCount();
+			}
+		}
+
+		return timing;
+	}
+
+	// The largest distance of the same vertex of both systems over the frames
+	float compareDrag(const ParticleExpression& behavior, std::size_t frames)
+	{
+		ParticleSystem native, expression;
+
+		setupDrag(native, nullptr);
+		setupDrag(expression, &behavior);
+
+		float error = 0.0f;
+
+		for (std::size_t frame = 0; frame < frames; ++frame)
+		{
+			native.update(dt);
+			expression.update(dt);
+
+			const auto& native_vertices = native.getVertices();
+			const auto& vertices = expression.getVertices();
+
+			if (native_vertices.size() != vertices.size())
+				return INFINITY;
+
+			for (std::size_t i = 0; i < vertices.size(); ++i)
+				error = std::max(error, getError(native_vertices[i].position, vertices[i].position));
+		}
+
+		return error;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	std::size_t repeat = 10;
+	float tolerance = 0.05f;
+	std::unique_ptr<PerfCounters> counters;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!std::strcmp(argv[i], "--counters"))
+			counters = std::make_unique<PerfCounters>();
+		else if (i + 1 < argc && !std::strcmp(argv[i], "--repeat"))
+			repeat = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+		else if (i + 1 < argc && !std::strcmp(argv[i], "--tolerance"))
+			tolerance = std::strtof(argv[++i], nullptr);
+		else
+		{
+			std::cerr << "Usage: " << argv[0] << " [--repeat N] [--tolerance T] [--counters]\n";
+
+			return EXIT_FAILURE;
+		}
+	}
+
+	const Scenario scenarios[] =
+	{
+		{ "explosion", 50,  true,  20000, 20.0f, 0.0f,     150.0f, 0.0f,   0.0f,  sf::Vector2f(),              0.0f, sf::Vector2f(1.002f, 1.002f) },
+		{ "stream",    50,  true,  0,     0.0f,  12800.0f, 300.0f, -90.0f, 0.0f,  sf::Vector2f(),              0.0f, sf::Vector2f(1.0f, 1.0f) },
+		{ "fountain",  256, false, 0,     0.0f,  6400.0f,  300.0f, -90.0f, 60.0f, sf::Vector2f(10.0f, 10.0f), 1.0f, sf::Vector2f(1.001f, 1.001f) }
+	};
+
+	const Mode modes[] =
+	{
+		{ "soa",           false, false },
+		{ "fast_math",     true,  false },
+		{ "deterministic", false, true }
+	};
+
+	bool is_passed = true;
+
+	for (const auto& scenario : scenarios)
+	{
+		Timing legacy = timeLegacy(scenario, repeat, counters.get());
+
+		for (const auto& mode : modes)
+		{
+			Timing timing = timeSystem(scenario, mode, repeat, counters.get());
+
+			std::cout << "{\"scenario\":\"" << scenario.name << '"'
+				<< ",\"mode\":\"" << mode.name << '"'
+				<< ",\"particles\":" << timing.particle_frames / (repeat * scenario.frames)
+				<< ",\"legacy_ns_per_particle\":" << legacy.getNsPerParticle()
+				<< ",\"ns_per_particle\":" << timing.getNsPerParticle()
+				<< ",\"speedup\":" << legacy.getNsPerParticle() / std::max(timing.getNsPerParticle(), 1e-9);
+
+			if (counters)
+			{
+				std::cout << ",\"legacy_update_counters_per_particle\":";
+				legacy.update_counters.writeJson(std::cout, legacy.particle_frames);
+				std::cout << ",\"legacy_draw_counters_per_particle\":";
+				legacy.draw_counters.writeJson(std::cout, legacy.particle_frames);
+				std::cout << ",\"update_counters_per_particle\":";
+				timing.update_counters.writeJson(std::cout, timing.particle_frames);
+				std::cout << ",\"draw_counters_per_particle\":";
+				timing.draw_counters.writeJson(std::cout, timing.particle_frames);
+			}
+
+			if (scenario.is_compared)
+			{
+				Comparison comparison = compare(scenario, mode, tolerance);
+				bool is_matched = comparison.mismatched == 0;
+
+				std::cout << ",\"quads\":" << comparison.quads
+					<< ",\"mismatched\":" << comparison.mismatched
+					<< ",\"position_error\":" << comparison.position_error
+					<< ",\"size_error\":" << comparison.size_error
+					<< ",\"color_error\":" << comparison.color_error
+					<< ",\"passed\":" << (is_matched ? "true" : "false");
+
+				is_passed = is_passed && is_matched;
+			}
+
+			std::cout << "}\n";
+		}
+	}
+
+	ParticleExpression behavior;
+
+	if (!behavior.compile(getDragSource()))
+	{
+		std::cerr << "The drag behavior doesn't compile: " << behavior.getError() << '\n';
+
+		return EXIT_FAILURE;
+	}
+
+	constexpr std::size_t drag_frames = 256;
+
+	Timing native = timeDrag(nullptr, drag_frames, repeat, counters.get());
+	Timing expression = timeDrag(&behavior, drag_frames, repeat, counters.get());
+	double ratio = expression.getNsPerParticle() / std::max(native.getNsPerParticle(), 1e-9);
+	float position_error = compareDrag(behavior, drag_frames);
+	bool is_drag_passed = position_error <= tolerance && ratio <= max_drag_ratio;
+
+	std::cout << "{\"scenario\":\"drag\""
+		<< ",\"particles\":" << native.particle_frames / (repeat * drag_frames)
+		<< ",\"native_update_ns_per_particle\":" << native.getNsPerParticle()
+		<< ",\"behavior_update_ns_per_particle\":" << expression.getNsPerParticle()
+		<< ",\"ratio\":" << ratio
+		<< ",\"max_ratio\":" << max_drag_ratio;
+
+	if (counters)
+	{
+		std::cout << ",\"native_update_counters_per_particle\":";
+		native.update_counters.writeJson(std::cout, native.particle_frames);
+		std::cout << ",\"behavior_update_counters_per_particle\":";
+		expression.update_counters.writeJson(std::cout, expression.particle_frames);
+	}
+
+	std::cout << ",\"position_error\":" << position_error
+		<< ",\"passed\":" << (is_drag_passed ? "true" : "false")
+		<< "}\n";
+
+	is_passed = is_passed && is_drag_passed;
+
+	return is_passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,36 @@
+# Compares the code of two object files
+#
+# Disassembles both, with the relocations, so the calls name their
+# targets, and fails, if they differ; the two listings are then left
+# next to the objects (.s) for a diff. The headers with the paths of
+# the files are skipped.
+#
+# Usage:
+# cmake -DOBJDUMP=objdump -DEXPECTED=bare.o -DACTUAL=disabled.o -P CompareObjects.cmake
+
+function(disassemble path result)
+	execute_process(COMMAND "${OBJDUMP}" -dr --no-show-raw-insn "${path}"
+		OUTPUT_VARIABLE text RESULT_VARIABLE status)
+
+	if(NOT status EQUAL 0)
+		message(FATAL_ERROR "${OBJDUMP} failed on ${path}")
+	endif()
+
+	string(REPLACE "${path}" "" text "${text}")
+
+	set(${result} "${text}" PARENT_SCOPE)
+endfunction()
+
+disassemble("${EXPECTED}" expected)
+disassemble("${ACTUAL}" actual)
+
+string(LENGTH "${expected}" size)
+
+if(NOT expected STREQUAL actual)
+	file(WRITE "${EXPECTED}.s" "${expected}")
+	file(WRITE "${ACTUAL}.s" "${actual}")
+
+	message(FATAL_ERROR "{\"identical\":false,\"expected\":\"${EXPECTED}.s\",\"actual\":\"${ACTUAL}.s\"}")
+endif()
+
+message(STATUS "{\"identical\":true,\"bytes\":${size}}")
@@ -0,0 +1,704 @@
+// Offline profiling of the particle presets
+//
+// Simulates every given preset without a window for a number
+// of seconds at a fixed time step and prints one JSON line per
+// preset: peak and average particles, peak memory, update and
+// vertex generation cost, the cost of every phase (spawn, integrate,
+// behavior, compaction and vertices, from ParticleSystem::Cost)
+// per particle, and the fill-rate coverage (the area of all the
+// particles in screens, averaged over the frames).
+// The presets are simulated in parallel.
+//
+// Usage:
+// Simulate [--seconds S] [--dt DT] [--screen W H] [--jobs N] [--counters]
+//          [--runs R] [--baseline FILE [--tolerance T]] preset...
+//
+// With --counters, the hardware counters (see PerfCounters.hpp) are
+// read around the update and the vertex generation of every frame
+// and written per particle; the reads add their own cost to the times.
+//
+// With --runs, every preset is simulated R times and the fastest
+// run is reported, which filters out the noise of the machine.
+//
+// With --baseline, the tool is the performance regression test:
+// FILE holds the earlier output of the tool (one JSON line per preset),
+// every preset is compared with its line and fails, if its ns_per_particle
+// grew by more than the fraction T (0.25 by default) or if it allocates
+// more often. A phase fails, if it grew by more than T and by more than
+// a nanosecond per particle, so the phases, that cost next to nothing,
+// don't fail on the noise. The lines get the baseline numbers, the failed
+// "regressions" and "passed", the last line sums it up, and the exit code
+// is a failure, if any preset fails.
+// The presets are matched by their path, so run it from the directory,
+// that the baseline was made in.
+//
+// Preset is a text file of "key = values" lines, '#' starts
+// a comment. The keys follow the setters of ParticleSystem:
+//
+// particle_size = 32 32
+// particle_size_range = 16 16 48 48
+// emitter = 0 0
+// direction = -90
+// dispersion = 60
+// velocity = 100
+// velocity_range = 50 150
+// angular_velocity_range = -90 90
+// respawn_rate = 500
+// respawn_area = 10 10
+// lifetime = 2
+// lifetime_range = 1 3
+// exponential_growth = 1.001 1.001
+// acceleration = 0 98
+// drag = 0.5
+// integrator = exact
+// sleeping = 2 30
+// time_scale = 0.5
+// behavior = vx = vx + noise(x * 0.01, y * 0.01) * 100 * dt; vy = vy + 98 * dt
+// palette = ff8040ff ffffffff
+// emitted = 1
+// attenuated = 1
+// fast_math = 1
+// deterministic = 1
+// explosion = 500 20
+// seed = 1
+
+#include "../ParticleSystem.hpp"
+#include "../PerfCounters.hpp"
+#include "TrackingResource.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	struct Phase
+	{
+		const char* name;
+		std::int64_t ParticleSystem::Cost::* time;
+	};
+
+	constexpr Phase phases[] =
+	{
+		{ "spawn",      &ParticleSystem::Cost::spawn_time },
+		{ "integrate",  &ParticleSystem::Cost::integrate_time },
+		{ "behavior",   &ParticleSystem::Cost::behavior_time },
+		{ "compaction", &ParticleSystem::Cost::compaction_time },
+		{ "vertices",   &ParticleSystem::Cost::vertices_time }
+	};
+
+	constexpr std::size_t phase_count = sizeof(phases) / sizeof(phases[0]);
+
+	// Below it the growth of a phase is the noise
+	constexpr double phase_slack_ns = 1.0;
+
+	struct Options
+	{
+		float        seconds = 10.0f;
+		float        dt      = 1.0f / 60.0f;
+		sf::Vector2f screen  = sf::Vector2f(1920.0f, 1080.0f);
+		unsigned     jobs    = std::max(1u, std::thread::hardware_concurrency());
+		unsigned     runs    = 1;
+		std::string  baseline;
+		double       tolerance = 0.25;
+		bool         counters  = false;
+
+		std::vector<std::string> presets;
+	};
+
+	struct Report
+	{
+		std::string error;
+
+		std::size_t frames            = 0;
+		std::size_t peak_particles    = 0;
+		double      average_particles = 0.0;
+		std::size_t peak_memory       = 0;
+		double      update_ns         = 0.0; // per frame
+		double      vertices_ns       = 0.0; // per frame
+		double      coverage          = 0.0; // in screens, per frame
+		std::size_t allocations       = 0;
+		double      phase_ns[phase_count] = {}; // per frame
+
+		PerfCounters::Sample update_counters;   // in total, with --counters
+		PerfCounters::Sample vertices_counters; // in total, with --counters
+	};
+
+	// Line of the baseline file
+	struct Baseline
+	{
+		double      ns_per_particle = 0.0;
+		std::size_t allocations     = 0;
+		bool        has_phases      = false; // the older baselines have none
+		double      phase_ns_per_particle[phase_count] = {};
+	};
+
+	bool parseOptions(int argc, char* argv[], Options& options)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const char* arg = argv[i];
+
+			if (arg[0] != '-')
+			{
+				options.presets.emplace_back(arg);
+				continue;
+			}
+
+			if (!std::strcmp(arg, "--counters"))
+			{
+				options.counters = true;
+				continue;
+			}
+
+			if (i + 1 >= argc)
+				return false;
+
+			if (!std::strcmp(arg, "--seconds"))   options.seconds = std::strtof(argv[++i], nullptr);
+			else if (!std::strcmp(arg, "--dt"))   options.dt = std::strtof(argv[++i], nullptr);
+			else if (!std::strcmp(arg, "--jobs")) options.jobs = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+			else if (!std::strcmp(arg, "--runs")) options.runs = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+			else if (!std::strcmp(arg, "--baseline"))  options.baseline = argv[++i];
+			else if (!std::strcmp(arg, "--tolerance")) options.tolerance = std::strtod(argv[++i], nullptr);
+			else if (!std::strcmp(arg, "--screen") && i + 2 < argc)
+			{
+				options.screen.x = std::strtof(argv[++i], nullptr);
+				options.screen.y = std::strtof(argv[++i], nullptr);
+			}
+			else
+				return false;
+		}
+
+		return !options.presets.empty() && options.dt > 0.0f && options.tolerance >= 0.0;
+	}
+
+	// Apply the preset to the system, return the error message if any
+	std::string loadPreset(const std::string& path, ParticleSystem& system, ParticleExpression& behavior)
+	{
+		std::ifstream file(path);
+
+		if (!file)
+			return "can't open the file";
+
+		std::string line;
+		int line_number = 0;
+
+		while (std::getline(file, line))
+		{
+			++line_number;
+
+			line = line.substr(0, line.find('#'));
+
+			std::size_t equal = line.find('=');
+
+			if (equal == std::string::npos)
+			{
+				if (line.find_first_not_of(" \t\r") != std::string::npos)
+					return "missing '=' at line " + std::to_string(line_number);
+
+				continue;
+			}
+
+			std::istringstream key_stream(line.substr(0, equal));
+			std::istringstream values(line.substr(equal + 1));
+			std::string key;
+			key_stream >> key;
+
+			float a = 0.0f, b = 0.0f, c = 0.0f, d = 0.0f;
+
+			if (key == "particle_size" && values >> a >> b)
+				system.setParticleSize(sf::Vector2f(a, b));
+			else if (key == "particle_size_range" && values >> a >> b >> c >> d)
+				system.setParticleSizeRange(sf::Vector2f(a, b), sf::Vector2f(c, d));
+			else if (key == "emitter" && values >> a >> b)
+				system.setEmitter(sf::Vector2f(a, b));
+			else if (key == "direction" && values >> a)
+				system.setDirection(sf::degrees(a));
+			else if (key == "dispersion" && values >> a)
+				system.setDispersion(sf::degrees(a));
+			else if (key == "velocity" && values >> a)
+				system.setVelocity(a);
+			else if (key == "velocity_range" && values >> a >> b)
+				system.setVelocityRange(a, b);
+			else if (key == "angular_velocity_range" && values >> a >> b)
+				system.setAngularVelocityRange(sf::degrees(a), sf::degrees(b));
+			else if (key == "respawn_rate" && values >> a)
+				system.setRespawnRate(a);
+			else if (key == "respawn_area" && values >> a >> b)
+				system.setRespawnArea(sf::Vector2f(a, b));
+			else if (key == "lifetime" && values >> a)
+				system.setLifeTime(a);
+			else if (key == "lifetime_range" && values >> a >> b)
+				system.setLifeTimeRange(a, b);
+			else if (key == "exponential_growth" && values >> a >> b)
+				system.setExponentialGrowth(sf::Vector2f(a, b));
+			else if (key == "acceleration" && values >> a >> b)
+				system.setAcceleration(sf::Vector2f(a, b));
+			else if (key == "drag" && values >> a)
+				system.setDrag(a);
+			else if (key == "integrator")
+			{
+				std::string name;
+				values >> name;
+
+				if (name == "semi_implicit_euler")
+					system.setIntegrator(ParticleSystem::Integrator::SemiImplicitEuler);
+				else if (name == "exact")
+					system.setIntegrator(ParticleSystem::Integrator::Exact);
+				else
+					return "bad integrator at line " + std::to_string(line_number);
+			}
+			else if (key == "sleeping" && values >> a >> b)
+				system.setSleeping(a, static_cast<std::size_t>(b));
+			else if (key == "time_scale" && values >> a)
+				system.setTimeScale(a);
+			else if (key == "emitted" && values >> a)
+				system.setEmitted(a != 0.0f);
+			else if (key == "attenuated" && values >> a)
+				system.setAttenuated(a != 0.0f);
+			else if (key == "fast_math" && values >> a)
+				system.setFastMath(a != 0.0f);
+			else if (key == "deterministic" && values >> a)
+				system.setDeterministic(a != 0.0f);
+			else if (key == "behavior")
+			{
+				if (!behavior.compile(line.substr(equal + 1)))
+					return "bad behavior at line " + std::to_string(line_number) + ": " + behavior.getError();
+
+				system.setBehavior(&behavior);
+			}
+			else if (key == "explosion" && values >> a >> b)
+				system.setExplosion(static_cast<std::size_t>(a), b);
+			else if (key == "seed" && values >> a)
+				system.setSeed(static_cast<std::uint32_t>(a));
+			else if (key == "palette")
+			{
+				std::vector<sf::Color> palette;
+				std::string hex;
+
+				while (values >> hex)
+				{
+					auto rgba = static_cast<std::uint32_t>(std::strtoul(hex.c_str(), nullptr, 16));
+					palette.emplace_back(rgba >> 24, (rgba >> 16) & 0xFF, (rgba >> 8) & 0xFF, rgba & 0xFF);
+				}
+
+				system.setPalette(palette);
+			}
+			else
+				return "bad key or values at line " + std::to_string(line_number);
+		}
+
+		return {};
+	}
+
+	// Area of the drawn quads, each of them is two triangles
+	double getCoverage(const ParticleSystem& system)
+	{
+		const auto& vertices = system.getVertices();
+		double area = 0.0;
+
+		for (std::size_t i = 0; i + 5 < vertices.size(); i += 6)
+		{
+			sf::Vector2f right = vertices[i + 1].position - vertices[i].position;
+			sf::Vector2f down = vertices[i + 5].position - vertices[i].position;
+
+			area += std::fabs(right.x * down.y - right.y * down.x);
+		}
+
+		return area;
+	}
+
+	double elapsedNs(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	Report simulate(const std::string& path, const Options& options)
+	{
+		TrackingResource resource;
+		Report report;
+
+		// Opened on the thread of the simulation, they count only it
+		std::unique_ptr<PerfCounters> counters;
+
+		if (options.counters)
+			counters = std::make_unique<PerfCounters>();
+
+		{
+			ParticleExpression behavior;
+			ParticleSystem system(&resource);
+
+			// Same preset, same numbers, unless the preset sets its own seed
+			system.setSeed(1);
+
+			report.error = loadPreset(path, system, behavior);
+
+			if (!report.error.empty())
+				return report;
+
+			report.frames = static_cast<std::size_t>(std::lround(options.seconds / options.dt));
+
+			double screen_area = static_cast<double>(options.screen.x) * options.screen.y;
+			double particle_frames = 0.0;
+
+			for (std::size_t frame = 0; frame < report.frames; ++frame)
+			{
+				auto start = std::chrono::steady_clock::now();
+				PerfCounters::measure(counters.get(), report.update_counters, [&]() { system.update(options.dt); });
+				report.update_ns += elapsedNs(start);
+
+				start = std::chrono::steady_clock::now();
+				PerfCounters::measure(counters.get(), report.vertices_counters, [&]() { system.getVertices(); });
+				report.vertices_ns += elapsedNs(start);
+
+				report.coverage += getCoverage(system) / screen_area;
+
+				particle_frames += system.getParticleCount();
+				report.peak_particles = std::max(report.peak_particles, system.getParticleCount());
+			}
+
+			double frames = static_cast<double>(std::max<std::size_t>(report.frames, 1));
+
+			report.average_particles = particle_frames / frames;
+			report.update_ns /= frames;
+			report.vertices_ns /= frames;
+			report.coverage /= frames;
+
+			for (std::size_t phase = 0; phase < phase_count; ++phase)
+				report.phase_ns[phase] = system.getCost().*phases[phase].time / frames;
+		}
+
+		report.peak_memory = resource.getPeak();
+		report.allocations = resource.getAllocationCount();
+
+		return report;
+	}
+
+	double getNsPerParticle(const Report& report)
+	{
+		return (report.update_ns + report.vertices_ns) / std::max(report.average_particles, 1.0);
+	}
+
+	double getPhaseNsPerParticle(const Report& report, std::size_t phase)
+	{
+		return report.phase_ns[phase] / std::max(report.average_particles, 1.0);
+	}
+
+	// The fastest of the runs, the rest of the numbers is the same in all of them
+	Report measure(const std::string& path, const Options& options)
+	{
+		Report report = simulate(path, options);
+
+		for (unsigned run = 1; run < options.runs && report.error.empty(); ++run)
+		{
+			Report next = simulate(path, options);
+
+			if (getNsPerParticle(next) < getNsPerParticle(report))
+				report = next;
+		}
+
+		return report;
+	}
+
+	// Value of the key in a JSON line of the tool, the strings are unescaped
+	bool findValue(const std::string& line, const std::string& key, std::string& value)
+	{
+		std::size_t position = line.find('"' + key + "\":");
+
+		if (position == std::string::npos)
+			return false;
+
+		position += key.size() + 3;
+		value.clear();
+
+		if (position >= line.size() || line[position] != '"')
+		{
+			std::size_t end = line.find_first_of(",}", position);
+			value = line.substr(position, end - position);
+
+			return !value.empty();
+		}
+
+		for (++position; position < line.size() && line[position] != '"'; ++position)
+		{
+			char c = line[position];
+
+			if (c == '\\' && ++position < line.size())
+			{
+				c = line[position];
+
+				if (c == 'n') c = '\n';
+				else if (c == 'r') c = '\r';
+				else if (c == 't') c = '\t';
+				else if (c == 'u' && position + 4 < line.size())
+				{
+					c = static_cast<char>(std::strtoul(line.substr(position + 1, 4).c_str(), nullptr, 16));
+					position += 4;
+				}
+			}
+
+			value += c;
+		}
+
+		return position < line.size();
+	}
+
+	// Read the baseline file, return the error message if any
+	std::string loadBaseline(const std::string& path, std::map<std::string, Baseline>& baselines)
+	{
+		std::ifstream file(path);
+
+		if (!file)
+			return "can't open the baseline " + path;
+
+		std::string line;
+		int line_number = 0;
+
+		while (std::getline(file, line))
+		{
+			++line_number;
+
+			if (line.find_first_not_of(" \t\r") == std::string::npos)
+				continue;
+
+			std::string preset, error, ns_per_particle, allocations;
+
+			// The lines of the failed presets have no numbers
+			if (!findValue(line, "preset", preset) || findValue(line, "error", error)
+				|| !findValue(line, "ns_per_particle", ns_per_particle) || !findValue(line, "allocations", allocations))
+				return "bad baseline at line " + std::to_string(line_number);
+
+			Baseline& baseline = baselines[preset];
+			baseline.ns_per_particle = std::strtod(ns_per_particle.c_str(), nullptr);
+			baseline.allocations = std::strtoul(allocations.c_str(), nullptr, 10);
+			baseline.has_phases = true;
+
+			for (std::size_t phase = 0; phase < phase_count; ++phase)
+			{
+				std::string value;
+
+				if (!findValue(line, phases[phase].name, value))
+					baseline.has_phases = false;
+
+				baseline.phase_ns_per_particle[phase] = std::strtod(value.c_str(), nullptr);
+			}
+		}
+
+		return {};
+	}
+
+	// Write the string as a JSON string, quoted and escaped
+	void printString(std::ostream& stream, const std::string& string)
+	{
+		const char* hex = "0123456789abcdef";
+
+		stream << '"';
+
+		for (char c : string)
+		{
+			auto code = static_cast<unsigned char>(c);
+
+			if (c == '"' || c == '\\')
+				stream << '\\' << c;
+			else if (c == '\n')
+				stream << "\\n";
+			else if (c == '\r')
+				stream << "\\r";
+			else if (c == '\t')
+				stream << "\\t";
+			else if (code < 0x20 || code == 0x7F)
+				stream << "\\u00" << hex[code >> 4] << hex[code & 0xF];
+			else
+				stream << c;
+		}
+
+		stream << '"';
+	}
+
+	// Write the per particle costs of the phases as a JSON object
+	void printPhases(std::ostream& stream, const double (&ns_per_particle)[phase_count])
+	{
+		stream << '{';
+
+		for (std::size_t phase = 0; phase < phase_count; ++phase)
+			stream << (phase ? "," : "") << '"' << phases[phase].name << "\":" << ns_per_particle[phase];
+
+		stream << '}';
+	}
+
+	// The baseline is nullptr, unless the tool compares with the baseline
+	bool printReport(std::ostream& stream, const std::string& path, const Report& report, const Baseline* baseline, const Options& options)
+	{
+		stream << "{\"preset\":";
+		printString(stream, path);
+
+		if (!report.error.empty())
+		{
+			stream << ",\"error\":";
+			printString(stream, report.error);
+			stream << (options.baseline.empty() ? "" : ",\"passed\":false") << "}\n";
+			return false;
+		}
+
+		double ns_per_particle = getNsPerParticle(report);
+		double phase_ns_per_particle[phase_count];
+
+		for (std::size_t phase = 0; phase < phase_count; ++phase)
+			phase_ns_per_particle[phase] = getPhaseNsPerParticle(report, phase);
+
+		stream << ",\"frames\":" << report.frames
+			<< ",\"peak_particles\":" << report.peak_particles
+			<< ",\"average_particles\":" << report.average_particles
+			<< ",\"peak_memory\":" << report.peak_memory
+			<< ",\"update_ns\":" << report.update_ns
+			<< ",\"vertices_ns\":" << report.vertices_ns
+			<< ",\"ns_per_particle\":" << ns_per_particle
+			<< ",\"coverage\":" << report.coverage
+			<< ",\"allocations\":" << report.allocations
+			<< ",\"phase_ns_per_particle\":";
+
+		printPhases(stream, phase_ns_per_particle);
+
+		if (options.counters)
+		{
+			double particle_frames = report.average_particles * report.frames;
+
+			stream << ",\"update_counters_per_particle\":";
+			report.update_counters.writeJson(stream, particle_frames);
+			stream << ",\"vertices_counters_per_particle\":";
+			report.vertices_counters.writeJson(stream, particle_frames);
+		}
+
+		bool is_passed = true;
+
+		if (baseline)
+		{
+			std::vector<const char*> regressions;
+
+			if (ns_per_particle > baseline->ns_per_particle * (1.0 + options.tolerance))
+				regressions.push_back("ns_per_particle");
+
+			if (report.allocations > baseline->allocations)
+				regressions.push_back("allocations");
+
+			for (std::size_t phase = 0; phase < phase_count && baseline->has_phases; ++phase)
+			{
+				double limit = baseline->phase_ns_per_particle[phase];
+				limit = std::max(limit * (1.0 + options.tolerance), limit + phase_slack_ns);
+
+				if (phase_ns_per_particle[phase] > limit)
+					regressions.push_back(phases[phase].name);
+			}
+
+			is_passed = regressions.empty();
+
+			stream << ",\"baseline_ns_per_particle\":" << baseline->ns_per_particle
+				<< ",\"baseline_allocations\":" << baseline->allocations;
+
+			if (baseline->has_phases)
+			{
+				stream << ",\"baseline_phase_ns_per_particle\":";
+				printPhases(stream, baseline->phase_ns_per_particle);
+			}
+
+			stream << ",\"regressions\":[";
+
+			for (std::size_t i = 0; i < regressions.size(); ++i)
+				stream << (i ? ",\"" : "\"") << regressions[i] << '"';
+
+			stream << ']';
+		}
+		else if (!options.baseline.empty())
+		{
+			is_passed = false;
+			stream << ",\"error\":\"not in the baseline\"";
+		}
+
+		if (!options.baseline.empty())
+			stream << ",\"passed\":" << (is_passed ? "true" : "false");
+
+		stream << "}\n";
+
+		return is_passed;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	Options options;
+
+	if (!parseOptions(argc, argv, options))
+	{
+		std::cerr << "Usage: " << argv[0] << " [--seconds S] [--dt DT] [--screen W H] [--jobs N] [--counters]"
+			" [--runs R] [--baseline FILE [--tolerance T]] preset...\n";
+
+		return EXIT_FAILURE;
+	}
+
+	std::map<std::string, Baseline> baselines;
+
+	if (!options.baseline.empty())
+	{
+		std::string error = loadBaseline(options.baseline, baselines);
+
+		if (!error.empty())
+		{
+			std::cerr << error << '\n';
+
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::vector<Report> reports(options.presets.size());
+	std::atomic<std::size_t> next(0);
+
+	auto worker = [&]()
+	{
+		for (std::size_t i = next++; i < options.presets.size(); i = next++)
+			reports[i] = measure(options.presets[i], options);
+	};
+
+	std::vector<std::thread> threads;
+
+	for (unsigned i = 1; i < std::min<std::size_t>(options.jobs, options.presets.size()); ++i)
+		threads.emplace_back(worker);
+
+	worker();
+
+	for (auto& thread : threads)
+		thread.join();
+
+	std::size_t failed = 0;
+
+	for (std::size_t i = 0; i < reports.size(); ++i)
+	{
+		auto baseline = baselines.find(options.presets[i]);
+
+		if (!printReport(std::cout, options.presets[i], reports[i], baseline != baselines.end() ? &baseline->second : nullptr, options))
+			++failed;
+	}
+
+	if (!options.baseline.empty())
+	{
+		std::cout << "{\"baseline\":";
+		printString(std::cout, options.baseline);
+		std::cout << ",\"tolerance\":" << options.tolerance
+			<< ",\"presets\":" << reports.size()
+			<< ",\"failed\":" << failed
+			<< ",\"passed\":" << (failed == 0 ? "true" : "false")
+			<< "}\n";
+	}
+
+	return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,147 @@
+// Benchmark of the particle storage on the large pools
+//
+// Keeps 1M+ particles alive (a steady emission, the lifetime
+// is long enough for the pool to stay full) and measures the
+// update and the vertex generation per particle, with and without
+// the transparent huge pages, so the effect of the TLB misses
+// can be seen on the machine at hand. Prints one JSON line per run.
+// With --counters, the hardware counters (see PerfCounters.hpp)
+// are read around both phases and written per particle as well.
+//
+// Usage:
+// StorageBenchmark [--particles N] [--frames F] [--counters]
+//
+// Transparent huge pages work on Linux only, elsewhere both runs
+// are the same. Check /sys/kernel/mm/transparent_hugepage/enabled
+// is "always" or "madvise".
+
+#include "../ParticleSystem.hpp"
+#include "../PerfCounters.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+namespace
+{
+	struct Result
+	{
+		double update_ns   = 0.0; // per particle
+		double vertices_ns = 0.0; // per particle
+		double particles   = 0.0; // on average
+		std::size_t memory = 0;
+
+		PerfCounters::Sample update_counters;   // in total
+		PerfCounters::Sample vertices_counters; // in total
+		double particle_frames = 0.0;
+	};
+
+	double elapsedNs(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// The counters are nullptr, unless they are read
+	Result run(std::size_t particles, std::size_t frames, bool huge_pages, PerfCounters* counters)
+	{
+		constexpr float dt = 1.0f / 60.0f;
+		constexpr float lifetime = 10.0f;
+
+		ParticleSystem system;
+
+		system.setSeed(1);
+		system.setHugePages(huge_pages);
+		system.reserve(particles + particles / 8);
+		system.setVelocityRange(10.0f, 100.0f);
+		system.setDispersion(sf::degrees(180.0f));
+		system.setAngularVelocityRange(sf::degrees(-90.0f), sf::degrees(90.0f));
+		system.setLifeTimeRange(lifetime, lifetime);
+		system.setAttenuated(true);
+
+		// Fill the pool within a second, it lives
+		// for 11 seconds, so it stays full while measured
+		system.setRespawnRate(static_cast<float>(particles));
+		system.setEmitted(true);
+
+		for (float time = 0.0f; time < 1.0f; time += dt)
+			system.update(dt);
+
+		system.setEmitted(false);
+		system.getVertices();
+
+		Result result;
+		double particle_frames = 0.0;
+
+		for (std::size_t frame = 0; frame < frames; ++frame)
+		{
+			auto start = std::chrono::steady_clock::now();
+			PerfCounters::measure(counters, result.update_counters, [&]() { system.update(dt); });
+			result.update_ns += elapsedNs(start);
+
+			start = std::chrono::steady_clock::now();
+			PerfCounters::measure(counters, result.vertices_counters, [&]() { system.getVertices(); });
+			result.vertices_ns += elapsedNs(start);
+
+			particle_frames += system.getParticleCount();
+		}
+
+		particle_frames = std::max(particle_frames, 1.0);
+
+		result.particle_frames = particle_frames;
+		result.particles = particle_frames / std::max<std::size_t>(frames, 1);
+		result.update_ns /= particle_frames;
+		result.vertices_ns /= particle_frames;
+		result.memory = system.getMemoryUsage().getTotal();
+
+		return result;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	std::size_t particles = 1 << 20;
+	std::size_t frames = 120;
+	std::unique_ptr<PerfCounters> counters;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!std::strcmp(argv[i], "--counters"))
+			counters = std::make_unique<PerfCounters>();
+		else if (i + 1 < argc && !std::strcmp(argv[i], "--particles"))
+			particles = std::strtoul(argv[++i], nullptr, 10);
+		else if (i + 1 < argc && !std::strcmp(argv[i], "--frames"))
+			frames = std::strtoul(argv[++i], nullptr, 10);
+		else
+		{
+			std::cerr << "Usage: " << argv[0] << " [--particles N] [--frames F] [--counters]\n";
+
+			return EXIT_FAILURE;
+		}
+	}
+
+	for (bool huge_pages : { false, true })
+	{
+		Result result = run(particles, frames, huge_pages, counters.get());
+
+		std::cout << "{\"particles\":" << result.particles
+			<< ",\"huge_pages\":" << (huge_pages ? "true" : "false")
+			<< ",\"memory\":" << result.memory
+			<< ",\"update_ns_per_particle\":" << result.update_ns
+			<< ",\"vertices_ns_per_particle\":" << result.vertices_ns;
+
+		if (counters)
+		{
+			std::cout << ",\"update_counters_per_particle\":";
+			result.update_counters.writeJson(std::cout, result.particle_frames);
+			std::cout << ",\"vertices_counters_per_particle\":";
+			result.vertices_counters.writeJson(std::cout, result.particle_frames);
+		}
+
+		std::cout << "}\n";
+	}
+
+	return EXIT_SUCCESS;
+}
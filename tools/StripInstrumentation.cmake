@@ -0,0 +1,22 @@
+# Copies a source of the systems without any instrumentation
+#
+# Cuts out the PARTICLE_COST_SCOPE and PARTICLE_PROFILE_SCOPE lines
+# and the #if PARTICLE_SYSTEM_INSTRUMENTATION blocks, so the copy is
+# the source as if the instrumentation had never been written. The
+# check_instrumentation_bare test compares its object to the one of
+# the -DPARTICLE_SYSTEM_INSTRUMENTATION=0 build.
+#
+# Usage:
+# cmake -DINPUT=ParticleSystem.cpp -DOUTPUT=bare/ParticleSystem.cpp -P StripInstrumentation.cmake
+
+file(READ "${INPUT}" source)
+
+string(REGEX REPLACE "[ \t]*PARTICLE_(COST|PROFILE)_SCOPE\\([^)]*\\);" "" source "${source}")
+string(REGEX REPLACE "#if PARTICLE_SYSTEM_INSTRUMENTATION[^#]*#endif" "" source "${source}")
+
+# An #else or a nested directive would be left half cut
+if(source MATCHES "PARTICLE_SYSTEM_INSTRUMENTATION|PARTICLE_(COST|PROFILE)_SCOPE")
+	message(FATAL_ERROR "${INPUT}: the instrumentation left in the bare copy can't be cut out")
+endif()
+
+file(WRITE "${OUTPUT}" "${source}")
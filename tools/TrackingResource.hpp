@@ -0,0 +1,43 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory_resource>
+
+// Counts the memory, that the systems hold, and the allocations
+//
+// Forwards to the new/delete resource, not thread-safe,
+// so use one instance per thread
+class TrackingResource :
+	public std::pmr::memory_resource
+{
+public:
+	std::size_t getInUse() const { return m_in_use; }
+	std::size_t getPeak()  const { return m_peak; }
+	std::size_t getAllocationCount() const { return m_allocations; }
+
+private:
+	void* do_allocate(std::size_t bytes, std::size_t alignment) override
+	{
+		m_in_use += bytes;
+		m_peak = std::max(m_peak, m_in_use);
+		++m_allocations;
+
+		return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+	}
+
+	void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override
+	{
+		m_in_use -= bytes;
+		std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+	{
+		return this == &other;
+	}
+
+	std::size_t m_in_use = 0;
+	std::size_t m_peak = 0;
+	std::size_t m_allocations = 0;
+};